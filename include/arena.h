@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)  // the reserve is rounded up to this size, so huge pages can back it
+
+typedef enum {
+    ARENA_PAGES_NORMAL = 0,         // base pages only
+    ARENA_PAGES_TRANSPARENT = 1,    // transparent huge pages were asked for and the kernel has them turned on
+    ARENA_PAGES_HUGETLB = 2,        // explicit huge pages, taken from the system pool for the whole reserve
+} arena_pages_t;
+
+/*Bump allocator for the data of one level, in a single mapping reserved up front. Every allocation lives
+  until the arena is reset for the next level, the mapping itself is only given back by arena_destroy.
+  A zeroed arena_t has nothing reserved yet.*/
+typedef struct {
+    unsigned char* base;            // start of the mapping, NULL before arena_init
+    size_t size;                    // bytes reserved
+    size_t used;                    // bytes handed out since the last reset, padding included
+    size_t peak;                    // most bytes any level used, everything below was written at least once
+    arena_pages_t pages;            // what backs the mapping, as arena_init got it
+} arena_t;
+
+/*Reserves 'reserve' bytes of address space. Pages only take memory once touched, and the kernel is asked to
+  back them with transparent huge pages. With 'hugetlb' the whole reserve is first asked for in explicit huge
+  pages, which the system pool hands out up front. Asks for less if the reserve does not fit in the address
+  space.
+  Returns 0 on success, -1 if nothing could be reserved.*/
+int arena_init(arena_t* arena, size_t reserve, int hugetlb);
+
+/*Name of 'pages' for the logs*/
+const char* arena_pages_name(arena_pages_t pages);
+
+/*Zeroed 'size' bytes, aligned for any type.
+  Returns NULL if they do not fit in the reserve.*/
+void* arena_alloc(arena_t* arena, size_t size);
+
+/*Same as arena_alloc, aligned to 'align', a power of two*/
+void* arena_alloc_aligned(arena_t* arena, size_t size, size_t align);
+
+/*Copy of the 'len' first bytes of 'str', NUL-terminated.
+  Returns NULL if it does not fit in the reserve.*/
+char* arena_strndup(arena_t* arena, const char* str, size_t len);
+
+/*Forgets every allocation at once, keeping the mapping and its pages for the next level*/
+void arena_reset(arena_t* arena);
+
+/*Gives the mapping back, the arena has nothing reserved afterwards*/
+void arena_destroy(arena_t* arena);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include "board.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define AUTOSAVE_MAGIC "PACSAVE\0"
+#define AUTOSAVE_VERSION 5
+
+/*
+Layout of an autosave file:
+  autosave_header_t
+  'snapshot_size' bytes written by snapshot_encode for the level being played
+Every field has a fixed width, the entities are snapshot_entity_t records rather than the structs of the
+game. The file is written to '<path>.tmp', synced, renamed over '<path>' and the directory synced, so a crash
+leaves either the previous autosave or the new one, never a torn file or a lost rename.
+*/
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;                  // master seed, the levels still to be loaded seed their entities from it
+    int32_t level;                  // level being played, counted from 1
+    char level_file[MAX_FILENAME];  // its file, to refuse an autosave of another level set
+    uint32_t padding;
+    int64_t total_turns;            // turns played in the whole game
+    uint64_t snapshot_size;
+} autosave_header_t;
+
+/*Starts the thread writing the autosaves into 'path'.
+  Returns 0 on success, -1 if the thread could not be created.*/
+int autosave_start(const char* path);
+
+/*Copies the level being played into the free buffer and hands it to the writer thread, never waits for
+  the disk. If the writer is still busy with the previous autosave, the pending one is replaced.*/
+void autosave_submit(const board_t* board);
+
+/*Waits until every submitted autosave is on disk, needed before fork so the child does not lose one*/
+void autosave_wait();
+
+/*Recreates the writer thread in the child of a fork, the only thread that survives it is the caller*/
+int autosave_restart_after_fork();
+
+/*Writes the pending autosave, stops the writer thread and frees the buffers*/
+void autosave_stop();
+
+/*Removes the autosave file, the game it held is over*/
+void autosave_discard();
+
+/*Reads the autosave 'path', fills 'header' and returns the snapshot it holds, to be freed by the caller.
+  Returns NULL if the file cannot be read or is not an autosave.*/
+void* autosave_load(const char* path, autosave_header_t* header);
+
+/*Prints the number of autosaves, their size and write latency to 'out', nothing if none was written*/
+void autosave_report(FILE* out);
+
+#endif
@@ -1,19 +1,40 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include "arena.h"
+#include "options.h"
+#include "rng.h"
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
-#define MAX_MOVES 20
 #define MAX_LEVELS 20
 #define MAX_DIRNAME 256
 #define MAX_FILENAME 320
-#define MAX_GHOSTS 25
+
+#define LOCK_STRIPES 256             // mutexes of the stripe locking mode, a power of two
+
+#define TILE_SHIFT 6
+#define TILE_SIZE (1 << TILE_SHIFT)  // cells on each side of a tile, one 64-bit plane word per tile row
+#define TILE_MASK (TILE_SIZE - 1)
+#define TILE_CELLS (TILE_SIZE * TILE_SIZE)
+
+#define PLANE_WALLS 0                // planes of a tile
+#define PLANE_DOTS 1                 // the cells that still have a dot, only the pacmans clear them
+#define PLANE_PORTALS 2
+#define N_PLANES 3
+
+#define OCC_EMPTY 0                  // occupancy of a cell without entities
+#define OCC_PACMAN (1u << 30)        // occupancy of a cell with pacman 'id' is OCC_PACMAN | id
+#define OCC_GHOST (1u << 31)         // occupancy of a cell with ghost 'id' is OCC_GHOST | id
+#define OCC_ID_MASK (OCC_PACMAN - 1)
 
 #define CONTINUE_PLAY 0
 #define NEXT_LEVEL 1        // Return this in backup instance too, indicates user reached last level for parent process
 #define QUIT_GAME 2         // Return this in backup instance too, indicates game should continue because pacman died
 #define QUIT_GAME_FORCED 3  // Return this in backup instance too, indicates game should quit because user pressed 'Q'
 #define BACKUP_WON_GAME 4   // Return this in backup instance too, indicates user reached last level
+#define TURN_LIMIT_REACHED 5 // Game stopped because the turn limit given in the options was reached
 
 typedef enum {
     VALID_MOVE = 4,
@@ -31,12 +52,21 @@ typedef struct {
     int turns_left;
 } command_t;
 
+typedef struct {
+    long moves;                  // moves that had to synchronise with the other entities
+    long contended;              // moves that found a cell taken by another thread
+    long retries;                // failed attempts before the move went through
+    long long waited_ns;         // time spent in backoff sleeps or blocked on a lock
+} lock_stats_t;
+
 typedef struct {
     int pos_x, pos_y;            // current position (lock needed)
-    int alive;                   // if is alive      (lock needed)
+    atomic_int alive;            // if is alive, ghosts may clear it while the pacman plays
     int points;                  // how many points have been collected
     int passo;                   // number of plays to wait before starting
-    command_t moves[MAX_MOVES];
+    command_t* moves;            // the n_moves predefined moves, in the level arena
+    rng_t rng;                   // random moves and lock backoff, only touched by the thread playing it
+    lock_stats_t lock_stats;     // contention of its moves, only counted with the contention option
     int n_moves;                 // number of predefined moves, 0 if controlled by user, >0 if readed from level file
     int current_move;
     int waiting;
@@ -46,7 +76,9 @@ typedef struct {
 typedef struct {
     int pos_x, pos_y;            // current position
     int passo;                   // number of plays to wait between each move
-    command_t moves[MAX_MOVES];
+    command_t* moves;            // the n_moves moves, in the level arena
+    rng_t rng;                   // random moves and lock backoff, only touched by the thread playing it
+    lock_stats_t lock_stats;     // contention of its moves, only counted with the contention option
     int n_moves;                 // number of predefined moves from level file
     int current_move;
     int waiting;
@@ -54,16 +86,42 @@ typedef struct {
 } ghost_t;
 
 typedef struct {
-    char content;                // stuff like 'P' for pacman 'M' for monster/ghost and 'W' for wall
-    int has_dot;                 // whether there is a dot in this position or not
-    int has_portal;              // whether there is a portal in this position or not
-    pthread_rwlock_t rwlock;     // rwlock for thread safety
-} board_pos_t;
+    _Alignas(64) pthread_mutex_t mutex;  // one per cache line, stripes taken by different threads do not share it
+} lock_stripe_t;
+
+/*
+64x64 cells of the board. A tile is only allocated once the level puts something other than a wall in it,
+the tiles left out of the board are all walls. Cells are numbered tile by tile, see cell_index.
+*/
+typedef struct {
+    uint64_t planes[N_PLANES][TILE_SIZE];       // one word per row of the tile, bit i is column i
+    _Atomic uint64_t dirty[TILE_SIZE];          // cells changed since the last frame, same layout as the planes
+    atomic_int queued;                          // whether the tile is in the board's dirty_tiles
+    int tile_x, tile_y;                         // position in the tile directory
+    _Atomic uint32_t occupancy[TILE_CELLS];     // entity in each cell of the tile (OCC_*)
+    pthread_rwlock_t* cell_locks;               // rwlock of each cell, only for the rwlock locking of the pool engine
+    atomic_long* cell_contention;               // times a move found each cell taken, only with the contention option
+} tile_t;
+
+struct bundle;
+
+typedef struct {
+    long syscalls;               // syscalls made to read the level, pacman and ghost files
+    long bytes;                  // bytes read from those files
+    long long ns;                // time taken by load_level
+} load_stats_t;
 
 typedef struct {
-    char assets_dir[MAX_DIRNAME];    // directory where assets are located
+    char assets_dir[MAX_DIRNAME];    // directory where assets are located, or the level bundle file
+    const struct bundle* bundle;     // compiled levels to load from instead of the directory, NULL if unused
+    arena_t arena;                   // every per-level structure, reset by unload_level and reused by the next level
     int width, height;               // dimensions of the board
-    board_pos_t* board;              // actual board, a row-major matrix
+    int tiles_x, tiles_y;            // dimensions of the tile directory
+    tile_t** tiles;                  // tiles_x * tiles_y tiles, row-major, NULL for the ones that are all walls
+    tile_t** tile_list;              // the allocated tiles, in the order they were allocated
+    long n_tiles;                    // number of allocated tiles
+    long tile_capacity;              // room in tile_list
+    lock_stripe_t* lock_stripes;     // LOCK_STRIPES mutexes, only allocated for the stripe locking of the pool engine
     int n_pacmans;                   // number of pacmans in the board
     pacman_t* pacmans;               // array containing every pacman in the board to iterate through when processing (Just 1)
     int n_ghosts;                    // number of ghosts in the board
@@ -72,52 +130,131 @@ typedef struct {
     int current_level;               // index of the current level being played
     char level_file[MAX_FILENAME];   // file with the level layout
     char pacman_file[MAX_FILENAME];  // file with pacman movements
-    char ghosts_files[MAX_GHOSTS][MAX_FILENAME]; // files with monster movements
-    int tempo;                       // Duration of each play
+    char** ghosts_files;             // files with monster movements, one per ghost
+    int tempo_us;                    // duration of each play in microseconds (TEMPO is in milliseconds, with fractions)
     int has_saved;                   // flag to indicate if game state has already been saved
     int is_backup_instance;          // flag to indicate if this instance is a backup
-    int play_result;                 // result of the last play
-    pthread_rwlock_t play_res_rwlock;   // rwlock for play_result safe access
+    atomic_int play_result;          // most important result of the plays of this turn, see merge_play_result
     int level_result;                // result of the last level played
+    const game_options_t* opts;      // command line options of this run
+    long total_turns;                // number of turns played since the game started
+    load_stats_t load_stats;         // cost of loading the current level
+    tile_t** dirty_tiles;            // tiles with cells changed since the last frame, in no particular order
+    atomic_int n_dirty;              // number of queued tiles in dirty_tiles
+    int full_redraw;                 // whether the next frame must redraw every cell of the viewport
 } board_t;
 
-typedef struct {
-    board_t* board;
-    int pacman_id;
-} pacman_thread_arg_t;
+struct worker_pool;
 
-typedef struct {
-    board_t* board;
-    int ghost_id;
-} ghost_thread_arg_t;
+/*Index of cell (x, y): the tile in the directory, then the row and the column in the tile. Board sizes
+  past 2^31 cells need the 64 bits.*/
+static inline int64_t cell_index(const board_t* board, int x, int y) {
+    int64_t tile = (int64_t)(y >> TILE_SHIFT) * board->tiles_x + (x >> TILE_SHIFT);
+    return (tile << (2 * TILE_SHIFT)) | ((y & TILE_MASK) << TILE_SHIFT) | (x & TILE_MASK);
+}
+
+static inline tile_t* cell_tile(const board_t* board, int64_t index) {
+    return board->tiles[index >> (2 * TILE_SHIFT)];
+}
 
+static inline int cell_x(const board_t* board, int64_t index) {
+    return (int)((index >> (2 * TILE_SHIFT)) % board->tiles_x) * TILE_SIZE + (int)(index & TILE_MASK);
+}
+
+static inline int cell_y(const board_t* board, int64_t index) {
+    return (int)((index >> (2 * TILE_SHIFT)) / board->tiles_x) * TILE_SIZE + (int)((index >> TILE_SHIFT) & TILE_MASK);
+}
+
+/*Whether cell 'index' is set in 'plane', the cells of missing tiles are walls*/
+static inline int test_cell(const board_t* board, int plane, int64_t index) {
+    const tile_t* tile = cell_tile(board, index);
+    if (tile == NULL) return plane == PLANE_WALLS;
+    return (tile->planes[plane][(index >> TILE_SHIFT) & TILE_MASK] >> (index & TILE_MASK)) & 1;
+}
+
+/*Sets and clears cell 'index' in 'plane', its tile must be allocated*/
+static inline void set_cell(board_t* board, int plane, int64_t index) {
+    cell_tile(board, index)->planes[plane][(index >> TILE_SHIFT) & TILE_MASK] |= 1ULL << (index & TILE_MASK);
+}
+
+static inline void clear_cell(board_t* board, int plane, int64_t index) {
+    cell_tile(board, index)->planes[plane][(index >> TILE_SHIFT) & TILE_MASK] &= ~(1ULL << (index & TILE_MASK));
+}
+
+/*Occupancy of cell 'index', which is not a wall so its tile is allocated*/
+static inline _Atomic uint32_t* cell_occupancy(const board_t* board, int64_t index) {
+    return &cell_tile(board, index)->occupancy[index & (TILE_CELLS - 1)];
+}
+
+/*Queues cell 'index' to be drawn in the next frame, each tile is queued once*/
+static inline void mark_dirty(board_t* board, int64_t index) {
+    tile_t* tile = cell_tile(board, index);
+    atomic_fetch_or_explicit(&tile->dirty[(index >> TILE_SHIFT) & TILE_MASK], 1ULL << (index & TILE_MASK),
+                             memory_order_relaxed);
+    if (atomic_exchange_explicit(&tile->queued, 1, memory_order_relaxed) == 0) {
+        int slot = atomic_fetch_add_explicit(&board->n_dirty, 1, memory_order_relaxed);
+        board->dirty_tiles[slot] = tile;
+    }
+}
 
 /*UI Level Thread*/
 void play_level(board_t* board);
 
-/*Pacman Thread*/
-void* pacman_thread(void* arg);
+/*Plays one turn of a Pacman, called by the worker that picked it up*/
+void pacman_play(board_t* board, int pacman_id);
+
+/*Plays one turn of a Ghost(Monster), called by the worker that picked it up*/
+void ghost_play(board_t* board, int ghost_id);
+
+/*Plays one turn of entity 'entity': pacmans come first, then the ghosts*/
+void entity_play(board_t* board, int entity);
+
+/*Writes row 'y' as seen in the debug dumps into 'out', one character per cell: 'P' pacman, 'M' ghost,
+  'W' wall or ' '*/
+void board_row(const board_t* board, int y, char* out);
+
+/*Number of dots still on the board*/
+long count_dots(const board_t* board);
+
+/*Hash of the board as seen in the debug dumps and of the pacmans' points, to compare two runs*/
+uint64_t board_hash(const board_t* board);
+
+/*Allocates the tile directory for the width and height of 'board', every tile missing.
+  Returns 0 on success, -1 if it could not be allocated.*/
+int alloc_tiles(board_t* board);
+
+/*Tile of cell 'index', allocated all walls the first time it is asked for.
+  Returns NULL if it could not be allocated.*/
+tile_t* ensure_tile(board_t* board, int64_t index);
+
+/*Rebuilds the occupancy from the entity positions, after they were restored*/
+void rebuild_occupancy(board_t* board);
 
-/*Ghost(Monster) Thread*/
-void* ghost_thread(void* arg);
+/*Puts back the dot planes 'dots' of every allocated tile, in tile_list order, saved earlier in the level.
+  Only the cells whose dot changed are redrawn.*/
+void restore_dots(board_t* board, const uint64_t* dots);
 
 /*Process the death of a Pacman*/
 void kill_pacman(board_t* board, int pacman_index);
 
-/*Adds a pacman to the board*/
+/*Adds a pacman to the board.
+  Returns 0 on success, -1 if its script cannot be read or it starts outside the board.*/
 int load_pacman(board_t* board, int points);
 
-/*Adds a ghost(monster) to the board*/
-int load_ghost(board_t* board);
+/*Adds the ghosts(monsters) to the board.
+  Returns 0 on success, -1 if a script cannot be read or a ghost starts outside the board.*/
+int load_ghosts(board_t* board);
 
-/*Loads a level into board*/
+/*Loads a level into board, reserving its arena the first time.
+  Returns 0 on success, -1 if a file of the level cannot be read or is invalid, or if the arena could not be
+  reserved or the level does not fit in it.*/
 int load_level(board_t* board, int accumulated_points);
 
-/*Unloads levels loaded by load_level*/
+/*Unloads levels loaded by load_level, resetting the arena but keeping it reserved*/
 void unload_level(board_t * board);
 
-/*Creates a backup process for the current game state.
+/*Creates a backup process for the current game state, 'pool' is NULL for the serial engine.
   Returns 0 on success, -1 on failure.*/
-int create_backup(board_t* board, pthread_t* pacman_tid, pthread_t* ghosts_tid, pacman_thread_arg_t* pacman_args, ghost_thread_arg_t* ghost_args);
+int create_backup(board_t* board, struct worker_pool* pool);
 
 #endif
@@ -0,0 +1,89 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include "board.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUNDLE_MAGIC "PACBNDL\0"
+#define BUNDLE_VERSION 2
+#define BUNDLE_NAME_LEN 64
+
+#define BUNDLE_CELL_WALL 1
+#define BUNDLE_CELL_DOT 2
+#define BUNDLE_CELL_PORTAL 4
+
+/*
+Layout of a bundle file, every offset is from the start of the file and 8-byte aligned:
+  bundle_header_t
+  bundle_index_t[n_levels]              level i + 1 is entry i
+  per level: bundle_level_t, bundle_script_t[1 + n_ghosts] (pacman first),
+             bundle_command_t[] of each script, uint8_t cells[width * height]
+*/
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_levels;
+    uint64_t index_offset;
+} bundle_header_t;
+
+typedef struct {
+    uint64_t offset;                 // offset of the level's bundle_level_t
+    uint64_t size;                   // bytes taken by the level and everything it references
+} bundle_index_t;
+
+typedef struct {
+    char name[BUNDLE_NAME_LEN];      // level file the level was compiled from
+    int32_t width, height;
+    int32_t tempo_us;
+    int32_t n_ghosts;
+    uint64_t scripts_offset;         // 1 + n_ghosts bundle_script_t, the pacman first
+    uint64_t cells_offset;           // width * height BUNDLE_CELL_* flags, row-major
+} bundle_level_t;
+
+typedef struct {
+    char name[BUNDLE_NAME_LEN];      // script file, empty if the level has no PAC file
+    int32_t pos_x, pos_y;
+    int32_t passo;
+    int32_t n_moves;
+    uint64_t moves_offset;           // n_moves bundle_command_t
+} bundle_script_t;
+
+typedef struct {
+    int32_t turns;
+    char command;
+    char pad[3];
+} bundle_command_t;
+
+typedef struct bundle {
+    const uint8_t* data;             // the whole bundle file, mapped read-only
+    size_t size;
+    const bundle_header_t* header;
+    const bundle_index_t* index;
+} bundle_t;
+
+/*Whether 'path' names a regular file, and so a bundle rather than a levels directory*/
+int is_bundle_path(const char* path);
+
+/*Maps the bundle at 'path' and checks its header, its index and that every offset and count of each level
+  stays within that level's extent of the file.
+  Returns 0 on success, -1 on failure.*/
+int bundle_open(bundle_t* bundle, const char* path);
+
+void bundle_close(bundle_t* bundle);
+
+/*Equivalent of parse_level_file for level board->current_level of board->bundle*/
+int bundle_read_level(board_t* board);
+
+/*Equivalent of parse_pacman_file, a level without PAC file has nothing to read and succeeds*/
+int bundle_read_pacman(board_t* board);
+
+/*Equivalent of parse_ghost_file*/
+int bundle_read_ghost(board_t* board, int ghost_idx);
+
+/*Parses every level of 'levels_dir' with its pacman and ghost files and writes them to the bundle 'out_path'.
+  Returns 0 on success, -1 on failure.*/
+int bundle_compile(const char* levels_dir, const char* out_path);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef CONTENTION_H
+#define CONTENTION_H
+
+#include "board.h"
+
+#define CONTENTION_TOP_CELLS 10     // hottest cells listed in the report
+#define HEATMAP_MAX_COLS 64         // the heatmap merges blocks of cells to fit in this size
+#define HEATMAP_MAX_ROWS 32
+
+/*Writes the lock contention of the level just played to the debug file: totals, every entity,
+  the hottest cells and a heatmap of the board. Needs the contention option.*/
+void contention_report(const board_t* board);
+
+#endif
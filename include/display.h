@@ -17,9 +17,13 @@ Potential Structures for ncurses
 /*Initialize everything ncurses requires*/
 int terminal_init();
 
-/*Draw the board on the screen*/
+/*Draw the board on the screen: only the cells in the board's dirty set,
+  or all of them after a level change, a backup restore or a terminal resize*/
 void draw_board(board_t* board, int mode);
 
+/*Frames drawn and board cells drawn since the last call, then resets both counters*/
+void take_render_stats(long* frames, long* cells);
+
 /*Add a specific character with colour i into position (pos_x,pos_y) of the creen
 Pre loaded colours:
 1- Yellow
@@ -0,0 +1,27 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdio.h>
+
+#define FRAME_SPIN_NS 200000        // the end of each wait is spun, a timed sleep can wake up this late
+#define FRAME_MAX_LAG 4             // after an overrun the clock catches up this many frames, older ones are dropped
+
+/*Fixed-timestep clock: frame n starts at start + n * period, however long the previous frames took*/
+typedef struct {
+    long long period_ns;
+    long long deadline_ns;          // when the next frame starts
+    long long last_start_ns;        // when the previous frame started, 0 before the first one
+} frame_clock_t;
+
+/*Starts the clock, the first frame starts right away*/
+void frame_clock_start(frame_clock_t* clock, long long period_ns);
+
+/*Waits for the deadline of the next frame: sleeps until shortly before it with an absolute
+  clock_nanosleep, then spins. A frame already late starts right away, one too late is dropped.
+  With a period of 0 every frame starts right away.*/
+void frame_clock_wait(frame_clock_t* clock);
+
+/*Writes the frame period jitter percentiles of every clock of the run to 'out', if any frame was timed*/
+void frame_report(FILE* out);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5                                  // 32 buckets per power of two, about 3% precision
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/*Log-linear histogram of non-negative values (HdrHistogram style): exact below HIST_SUB_BUCKETS,
+  then every power of two split in HIST_SUB_BUCKETS buckets. Recording is a few instructions.*/
+typedef struct {
+    long count;
+    uint64_t min, max;
+    double sum;
+    long buckets[HIST_BUCKETS];
+} histogram_t;
+
+void hist_reset(histogram_t* hist);
+
+void hist_record(histogram_t* hist, uint64_t value);
+
+/*Adds every value recorded in 'other' to 'hist'*/
+void hist_merge(histogram_t* hist, const histogram_t* other);
+
+/*Value below which 'percentile' (0-100) percent of the recorded values are, within the bucket precision*/
+uint64_t hist_percentile(const histogram_t* hist, double percentile);
+
+double hist_mean(const histogram_t* hist);
+
+#endif
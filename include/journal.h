@@ -0,0 +1,77 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "board.h"
+#include "rng.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOURNAL_REWIND 50           // turns rewound by each press of the rewind key
+
+/*
+Ring of the turns played in the current level, newest last, each one holding the pre-image of the entities
+it changed and the cells whose dot was eaten. Walls and portals never change and the occupancy follows
+from the entities, so rewinding a turn only writes those back. The oldest turns are dropped when a new
+one does not fit in the budget. Each turn in the ring is:
+  journal_turn_t
+  journal_entity_t[n_entities]
+  uint32_t size, padding           the size again, to walk the ring back from the newest turn
+*/
+
+typedef struct {
+    int32_t entity;                 // pacmans first, then the ghosts
+    int32_t pos_x, pos_y;
+    int32_t points;                 // pacmans only
+    int32_t alive;                  // pacmans only
+    int32_t charged;                // ghosts only
+    int32_t current_move;
+    int32_t waiting;
+    int32_t turns_left;             // of the move at current_move, the one a T command counts down
+    int64_t dot;                    // cell whose dot the pacman ate in this turn (cell_index), -1 if none
+    rng_t rng;
+} journal_entity_t;
+
+typedef struct {
+    uint32_t size;                  // bytes of the whole turn, trailer included
+    uint32_t n_entities;
+} journal_turn_t;
+
+/*Allocates the ring, 'budget' bytes.
+  Returns 0 on success, -1 if it could not be allocated.*/
+int journal_init(size_t budget);
+
+/*Empties the ring and sizes the pre-images for the level in 'board'*/
+void journal_begin_level(const board_t* board);
+
+/*Whether turns are being journaled, false if the journal is disabled*/
+int journal_recording();
+
+/*Copies what a turn may change in entity 'entity' into 'out'*/
+void journal_capture(const board_t* board, int entity, journal_entity_t* out);
+
+/*Takes the pre-image of the pacmans, called by the UI thread before the entities play. The ghosts are
+  taken by the threads playing them, see journal_ghost_played.*/
+void journal_begin_turn(const board_t* board);
+
+/*Keeps 'pre', taken with journal_capture just before the ghost played, if the ghost changed. Called by the
+  thread that played it, so the UI thread never walks the ghosts.*/
+void journal_ghost_played(const board_t* board, const journal_entity_t* pre);
+
+/*Notes that pacman 'pacman_id' ate the dot of cell 'index', called from its move*/
+void journal_dot(int pacman_id, int64_t index);
+
+/*Appends the pacmans that changed since journal_begin_turn and the ghosts kept by journal_ghost_played to
+  the ring as a new turn*/
+void journal_end_turn(const board_t* board);
+
+/*Undoes the last 'turns' turns of the level being played.
+  Returns the turns undone, fewer if the ring did not hold that many.*/
+int journal_rewind(board_t* board, int turns);
+
+/*Drops every turn, they belong to another timeline after a snapshot is restored*/
+void journal_clear();
+
+/*Frees the ring*/
+void journal_free();
+
+#endif
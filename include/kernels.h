@@ -0,0 +1,41 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAP_BLOCK 64        // bytes classified per call, one bit per byte in each mask
+
+/*Classes of the bytes of a map row, bit i refers to byte i of the block*/
+typedef struct {
+    uint64_t walls;         // 'X'
+    uint64_t dots;          // 'o'
+    uint64_t portals;       // '@'
+} map_masks_t;
+
+/*Picks the fastest kernels the CPU supports (AVX2, SSE2 or scalar), call once before using them*/
+void kernels_init();
+
+/*Switches to the kernels of instruction set 'isa' ("scalar", "sse2" or "avx2"), to compare them.
+  Returns 0 on success, -1 if the CPU or the build does not support it.*/
+int kernels_use(const char* isa);
+
+/*Name of the instruction set picked by kernels_init*/
+const char* kernels_isa();
+
+/*Classifies the first 'len' (at most MAP_BLOCK) bytes of 'bytes', bits past 'len' are left clear*/
+void classify_map_block(const char* bytes, size_t len, map_masks_t* masks);
+
+/*Number of bits set in the 'n_words' words of a bitplane*/
+size_t count_bits(const uint64_t* words, size_t n_words);
+
+/*Writes one glyph per cell of a bitplane row of 'width' cells into 'out': glyphs[1] for a wall,
+  glyphs[2] for a portal, glyphs[3] for a dot and glyphs[0] for the other cells*/
+void expand_row(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t width,
+                const char glyphs[4], char* out);
+
+/*Index of the first word at or after 'from' where the 'n_words' words of 'a' and 'b' differ,
+  'n_words' if they are equal from there on*/
+size_t next_diff(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "board.h"
+
+/*Starts loading level 'level' on a background thread, using 'template' for the assets and options.
+  Returns 0 on success, -1 if the loader thread could not be started.*/
+int prefetch_level(const board_t* template, int level);
+
+/*Waits for the loader thread to finish, keeping the level it loaded (needed before fork)*/
+void prefetch_wait();
+
+/*Moves the prefetched level into 'board' if it is level 'level', adding 'points' to its pacman. The arenas
+  of the two boards are swapped, so 'board' must be unloaded and the loader reuses its arena for the next level.
+  Returns 0 if the level was taken, -1 if it was not prefetched or failed and must be loaded with load_level.*/
+int prefetch_take(board_t* board, int level, int points);
+
+/*Waits for the loader thread and frees any level it loaded that was not taken*/
+void prefetch_discard();
+
+/*Discards any prefetched level and gives back the arena the loader thread loads into*/
+void prefetch_close();
+
+/*Total load time hidden behind the levels being played and total time spent waiting for the loader*/
+void prefetch_stats(long long* hidden_ns, long long* waited_ns);
+
+#endif
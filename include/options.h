@@ -0,0 +1,55 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#define AUTOSAVE_EVERY 100           // default turns between two autosaves
+#define JOURNAL_BUDGET_KB 1024       // default memory of the rewind journal
+#define ARENA_RESERVE_MB 1024        // default address space reserved for each level arena
+
+typedef enum {
+    ENGINE_POOL = 0,             // entities played concurrently by the worker pool
+    ENGINE_SERIAL = 1,           // entities played one after the other on the UI thread, without locks
+} engine_t;
+
+typedef enum {
+    LOCKING_RWLOCK = 0,          // a rwlock per cell, both cells of a move locked with trylock and backoff
+    LOCKING_CAS = 1,             // moves claim the target cell with a compare-and-swap on its occupancy, no locks
+    LOCKING_STRIPE = 2,          // a fixed table of mutexes hashed by cell, both stripes of a move locked in order
+} locking_t;
+
+typedef enum {
+    BACKUP_SNAPSHOT = 0,         // quicksaves are copied into in-process snapshot slots
+    BACKUP_FORK = 1,             // a quicksave forks a backup process that resumes the game if the pacman dies
+} backup_t;
+
+typedef struct {
+    const char* levels_path;     // directory with the level files
+    int headless;                // run without ncurses, without frame sleeps and print a summary at exit
+    long max_turns;              // stop the game after this many turns, 0 means no limit
+    const char* pacman_file;     // pacman script used in every level instead of the level's PAC file, NULL if unset
+    int n_workers;               // threads playing the entities each turn, 0 means one per online core
+    engine_t engine;             // how the entities of each turn are played
+    locking_t locking;           // how the pool engine keeps concurrent moves consistent
+    backup_t backup;             // what a quicksave does
+    int contention;              // count lock contention per entity and per cell and report it at level end
+    int profile;                 // time every phase of each turn and print the histograms at exit
+    unsigned int seed;           // seed for the random movements
+    int has_seed;                // whether the seed was given, otherwise it comes from the clock
+    int log_level;               // most verbose log_level_t written to the debug file
+    const char* record_path;     // file the keys of the game are recorded into, NULL if unset
+    const char* replay_path;     // recorded game to replay headless, NULL if unset
+    const char* autosave_path;   // file the game is periodically saved into, NULL if unset
+    long autosave_every;         // turns between two autosaves
+    int resume;                  // continue the game saved in autosave_path
+    long journal_kb;             // memory of the rewind journal in KiB, 0 disables rewinding
+    long arena_mb;               // address space reserved for each level arena in MiB
+    int arena_hugetlb;           // back the level arenas with explicit huge pages from the system pool
+} game_options_t;
+
+/*Fills 'opts' from the command line arguments.
+  Returns 0 on success, -1 on invalid arguments.*/
+int parse_options(int argc, char** argv, game_options_t* opts);
+
+/*Prints the command line usage to stderr*/
+void print_usage(const char* prog);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "utils.h"
+#include <stdio.h>
+
+#define PROF_MAX_THREADS 256        // workers whose CPU time is kept, later ones are added to the last slot
+
+/*Phases of a turn of play_level, timed on the UI thread*/
+typedef enum {
+    PHASE_FRAME_WAIT = 0,           // waiting for the deadline of the turn
+    PHASE_RELEASE,                  // start of turn barrier, the workers are released
+    PHASE_SLOWEST_ENTITY,           // longest entity_play of the turn
+    PHASE_JOIN,                     // end of turn barrier, waiting for the workers still playing
+    PHASE_TURN,                     // every entity played, from the release to the end of the join
+    PHASE_RESULT,                   // result handling, create_backup included
+    PHASE_INPUT,                    // get_input or the replayed key
+    PHASE_RENDER,                   // screen_refresh
+    N_PHASES
+} phase_t;
+
+/*Enables the profiler and installs the SIGUSR1 handler that dumps it to the debug file*/
+void profiler_init();
+
+/*Whether profiler_init was called*/
+int profiler_enabled();
+
+void prof_record(phase_t phase, long long ns);
+
+/*Adds the CPU time of a worker thread that exited, read from CLOCK_THREAD_CPUTIME_ID*/
+void prof_add_thread_cpu(int worker_id, long long ns);
+
+/*Dumps the profile to the debug file if a SIGUSR1 arrived since the last call*/
+void prof_poll();
+
+/*Writes the p50/p99/max of every phase and the CPU time of every thread*/
+void prof_report(FILE* out);
+
+/*Records the time since '*mark' as 'phase' and moves the mark to now. Does nothing when the mark is 0,
+  which is how the callers keep the profiler off the hot path when it is disabled.*/
+static inline void prof_lap(long long* mark, phase_t phase) {
+    if (*mark == 0) return;
+    long long now = monotonic_ns();
+    prof_record(phase, now - *mark);
+    *mark = now;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "options.h"
+#include <stdint.h>
+
+#define REPLAY_MAGIC "PACRPLY\0"
+#define REPLAY_VERSION 3
+
+#define REPLAY_END '\0'             // the recorded game stopped at this turn
+#define REPLAY_RESUME '\1'          // a backup process died and its parent resumed the game here
+
+/*
+Layout of a replay file:
+  replay_header_t
+  events until the end of the file, each one is the difference to the turn of the previous event
+  (zigzag varint, turns go back when the parent of a backup resumes) followed by one key byte:
+  a key sampled after that turn, REPLAY_RESUME or REPLAY_END
+*/
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;                  // seed of the random movements
+    uint32_t engine;                // engine_t of the recorded game, informative
+    uint32_t backup;                // backup_t of the recorded game, version 1 files were always BACKUP_FORK
+    uint32_t journal_kb;            // rewind journal of the recorded game, since version 3
+} replay_header_t;
+
+/*Starts recording the game's keys into 'path'.
+  Returns 0 on success, -1 if the file could not be created.*/
+int record_open(const char* path, const game_options_t* opts);
+
+/*Records the key sampled after turn 'turn', nothing is written for '\0'*/
+void record_key(long turn, char key);
+
+/*Records that the parent of a backup resumed the game after turn 'turn'*/
+void record_resume(long turn);
+
+/*Writes out the buffered events, needed before fork so they are not written twice*/
+void record_flush();
+
+/*Records the turn the game stopped at and closes the file*/
+void record_close(long turn);
+
+/*Loads the replay 'path' and sets the seed, quicksave mode and journal size of 'opts' to the recorded ones.
+  Returns 0 on success, -1 if the file could not be read or is not a replay.*/
+int replay_open(const char* path, game_options_t* opts);
+
+/*Key to use after turn 'turn', '\0' if none was recorded for it*/
+char replay_key(long turn);
+
+/*Whether the recorded game stopped at or before turn 'turn'*/
+int replay_ended(long turn);
+
+/*Skips the events of the backup process that died, its parent resumes the game*/
+void replay_resume();
+
+/*Frees the loaded replay*/
+void replay_close();
+
+#endif
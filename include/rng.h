@@ -0,0 +1,47 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/*xoshiro256** generator, each entity owns one so random moves need no shared state*/
+typedef struct {
+    uint64_t s[4];
+} rng_t;
+
+static inline uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*Seeds 'rng' from the master 'seed' and the 'stream' of its owner, every stream gets an unrelated sequence*/
+static inline void rng_seed(rng_t* rng, uint64_t seed, uint64_t stream) {
+    uint64_t state = seed ^ splitmix64(&stream);
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&state);
+    }
+}
+
+static inline uint64_t rng_next(rng_t* rng) {
+    uint64_t* s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+/*Uniform number in [0, n)*/
+static inline uint32_t rng_below(rng_t* rng, uint32_t n) {
+    return (uint32_t)(((rng_next(rng) >> 32) * n) >> 32);
+}
+
+#endif
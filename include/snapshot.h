@@ -0,0 +1,76 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "board.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_SLOTS 9            // quicksave slots, chosen with the keys '1' to '9'
+
+/*
+In-process quicksave of the state a level changes while it is played. The walls and portals never
+change and the occupancy follows from the entities, so a snapshot only keeps:
+  snapshot_header_t
+  uint64_t dots[n_tiles][TILE_SIZE]             the dot plane of each allocated tile, in tile_list order
+  snapshot_entity_t[n_pacmans + n_ghosts]       pacmans first, then the ghosts
+The moves stay in the level arena and the contention counters are instrumentation of the whole game, a
+restored level keeps counting from where they are.
+*/
+
+typedef struct {
+    int32_t level;                  // level the snapshot was taken in
+    int32_t width, height;
+    int32_t n_pacmans, n_ghosts;
+    int32_t padding;
+    int64_t n_tiles;                // tiles the level allocated, the same every time it is loaded
+    int64_t total_turns;            // turn the snapshot was taken at, informative
+} snapshot_header_t;
+
+typedef struct {
+    int32_t pos_x, pos_y;
+    int32_t points;                 // pacmans only
+    int32_t alive;                  // pacmans only
+    int32_t charged;                // ghosts only
+    int32_t n_moves;                // of the script it played, to refuse a snapshot of another one
+    int32_t current_move;
+    int32_t waiting;
+    int32_t turns_left;             // of the move at current_move, the one a T command counts down
+    int32_t padding;
+    uint64_t rng[4];                // its generator, the random moves after a restore are the same
+} snapshot_entity_t;
+
+/*Bytes snapshot_encode needs for the level being played*/
+size_t snapshot_size(const board_t* board);
+
+/*Writes the state of the level being played into 'buffer', of at least snapshot_size bytes*/
+void snapshot_encode(const board_t* board, void* buffer);
+
+/*Restores the level being played from the 'size' bytes of 'buffer' written by snapshot_encode.
+  Returns 0 on success, -1 if they were encoded in another level, with other scripts or are corrupt, in which
+  case the board is left untouched.*/
+int snapshot_decode(board_t* board, const void* buffer, size_t size);
+
+/*Selects the slot used by the next save and restore, 'slot' in [0, SNAPSHOT_SLOTS)*/
+void snapshot_select(int slot);
+
+/*Slot selected by snapshot_select*/
+int snapshot_selected();
+
+/*Saves the state of the level being played into the selected slot.
+  Returns 0 on success, -1 if the slot could not be allocated.*/
+int snapshot_save(const board_t* board);
+
+/*Restores the level being played from 'slot'.
+  Returns 0 on success, -1 if the slot is empty or was saved in another level.*/
+int snapshot_restore(board_t* board, int slot);
+
+/*Slot saved most recently in the current level, -1 if none*/
+int snapshot_latest(const board_t* board);
+
+/*Empties 'slot', keeping its memory for the next save*/
+void snapshot_drop(int slot);
+
+/*Frees every slot*/
+void snapshot_free();
+
+#endif
@@ -3,24 +3,76 @@
 
 #include "board.h"
 
-/*Reads a line from file descriptor 'fd' into 'buffer' up to 'max_len' characters.
-  Returns the number of characters read, 0 on EOF, or -1 on error.*/
-int read_line(int fd, char *buffer, int max_len);
+#define READER_BLOCK_SIZE 65536
+
+/*Buffered line reader over a file descriptor, reads the file in blocks of READER_BLOCK_SIZE bytes*/
+typedef struct {
+    int fd;
+    int start;                   // first byte of the buffer not yet returned as a line
+    int end;                     // one past the last byte read into the buffer
+    int eof;                     // whether read() already returned 0
+    int error;                   // whether read() failed
+    long n_syscalls;             // read() calls made so far
+    long n_bytes;                // bytes read so far
+    char buffer[READER_BLOCK_SIZE + 1];
+} line_reader_t;
+
+/*Prepares 'reader' to read lines from 'fd', the caller keeps ownership of 'fd'*/
+void reader_init(line_reader_t* reader, int fd);
+
+/*Returns the next line without its '\n', NUL-terminated in place inside the reader's buffer,
+  so it is only valid until the next call. The length goes to 'len'.
+  Lines longer than READER_BLOCK_SIZE are returned in pieces.
+  Returns NULL on EOF or error.*/
+char* reader_next_line(line_reader_t* reader, int* len);
 
 /*Makes the current thread sleep for 'int milliseconds' miliseconds*/
 void sleep_ms(int milliseconds);
 
+/*Returns the current CLOCK_MONOTONIC time in nanoseconds*/
+long long monotonic_ns();
+
 // DEBUG FILE
+// Every thread writes its messages to its own lock-free ring buffer, a background
+// thread drains the rings into the debug file, so logging never blocks the caller.
+// A message that does not fit in its thread's ring is dropped and counted.
+
+#define LOG_RING_SIZE (1 << 17)      // bytes of ring buffer per thread
+#define LOG_MAX_MESSAGE 8192         // longer messages are truncated
 
-/*Opens the debug file*/
+typedef enum {
+    LOG_ERROR = 0,
+    LOG_WARN = 1,
+    LOG_INFO = 2,
+    LOG_DEBUG = 3,
+    LOG_TRACE = 4,                   // per entity and per turn messages of the hot path
+} log_level_t;
+
+/*Opens the debug file and starts its writer thread*/
 void open_debug_file(char *filename);
 
-/*Closes the debug file*/
+/*Writes every pending message, stops the writer thread and closes the debug file*/
 void close_debug_file();
 
+/*Messages above 'level' are discarded*/
+void set_log_level(log_level_t level);
+
+/*Parses a level name ("error", "warn", "info", "debug" or "trace"), returns -1 if unknown*/
+int parse_log_level(const char* name);
+
+/*Writes a timestamped message with level 'level' to the open debug file*/
+void log_write(log_level_t level, const char * format, ...);
+
 /*Writes to the open debug file*/
 void debug(const char * format, ...);
 
+/*Hot path messages, compiled out completely when building with NO_HOT_DEBUG (make HOT_DEBUG=0)*/
+#ifdef NO_HOT_DEBUG
+#define debug_hot(...) ((void)0)
+#else
+#define debug_hot(...) log_write(LOG_TRACE, __VA_ARGS__)
+#endif
+
 /*Writes the board and its contents to the open debug file*/
 void print_board(board_t* board);
 
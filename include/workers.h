@@ -0,0 +1,74 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "board.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define CACHE_LINE 64
+#define BARRIER_SPINS 4096   // times a thread polls the barrier before sleeping on it
+
+/*Sense-reversing barrier: every phase costs one atomic decrement per thread,
+  no matter how many entities were processed in between.*/
+typedef struct {
+    atomic_int count;        // threads that still have to arrive in the current phase
+    atomic_int sense;        // flipped by the last thread to arrive
+    int n_threads;           // threads taking part in the barrier
+    pthread_mutex_t mutex;   // slow path for threads that spun for too long
+    pthread_cond_t cond;
+} barrier_t;
+
+/*Entities [next, end) still to be played this turn by one worker, other workers steal from it when idle*/
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_int next;
+    int end;
+} work_queue_t;
+
+typedef struct worker_pool worker_pool_t;
+
+typedef struct {
+    worker_pool_t* pool;
+    int id;                  // 0 is the UI thread, which plays its share of the turn too
+    int sense;               // local sense for the barrier
+    pthread_t tid;
+    long long slowest_ns;    // longest entity_play of the current turn, only timed when profiling
+    long long cpu_ns;        // CPU time of the thread when it exited, only read when profiling
+} worker_t;
+
+struct worker_pool {
+    board_t* board;
+    int n_workers;           // workers including the UI thread
+    worker_t* workers;
+    work_queue_t* queues;    // one queue per worker
+    barrier_t barrier;       // crossed twice per turn: start of the turn and end of the turn
+    int stop;                // set by the UI thread to make workers exit at the next start of turn
+    int profile;             // time the phases of each turn for the profiler
+};
+
+void barrier_init(barrier_t* barrier, int n_threads);
+
+void barrier_destroy(barrier_t* barrier);
+
+/*Blocks until every thread of the barrier called it for the current phase*/
+void barrier_wait(barrier_t* barrier, int* local_sense);
+
+/*Number of workers to use: 'requested' if positive, else the number of online cores, capped at 'n_entities'*/
+int pool_size(int requested, int n_entities);
+
+/*Creates 'n_workers' - 1 worker threads, the calling thread is worker 0.
+  Returns 0 on success, -1 on failure, in which case the threads already created are joined and the pool
+  freed.*/
+int pool_start(worker_pool_t* pool, board_t* board, int n_workers);
+
+/*Plays one turn of every entity in the board, returns once all of them played*/
+void pool_run_turn(worker_pool_t* pool);
+
+/*Makes the worker threads exit and waits for them*/
+void pool_stop(worker_pool_t* pool);
+
+/*Recreates the worker threads in a child process after fork, where only the forking thread survives.
+  Returns 0 on success, -1 on failure, in which case the threads already created are joined again and the
+  pool is left with the calling thread alone, still to be stopped with pool_stop.*/
+int pool_restart_after_fork(worker_pool_t* pool);
+
+#endif
@@ -0,0 +1,105 @@
+#define _DEFAULT_SOURCE     // MAP_ANONYMOUS, MAP_NORESERVE, MAP_HUGETLB and MADV_HUGEPAGE
+#include "arena.h"
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+static int transparent_enabled();
+
+
+int arena_init(arena_t* arena, size_t reserve, int hugetlb) {
+    memset(arena, 0, sizeof(*arena));
+    reserve = (reserve + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+    if (reserve == 0) reserve = ARENA_HUGE_PAGE;
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages are taken from the system pool for the whole reserve up front, only when asked for
+    if (hugetlb) {
+        void* base = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            arena->base = base;
+            arena->size = reserve;
+            arena->pages = ARENA_PAGES_HUGETLB;
+            return 0;
+        }
+    }
+#else
+    (void)hugetlb;
+#endif
+
+    // Otherwise only address space, the kernel may back what is touched with transparent huge pages
+    for (; reserve >= ARENA_HUGE_PAGE; reserve /= 2) {
+        void* base = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) continue;
+        arena->base = base;
+        arena->size = reserve;
+        arena->pages = ARENA_PAGES_NORMAL;
+#ifdef MADV_HUGEPAGE
+        if (madvise(base, reserve, MADV_HUGEPAGE) == 0 && transparent_enabled()) {
+            arena->pages = ARENA_PAGES_TRANSPARENT;
+        }
+#endif
+        return 0;
+    }
+    return -1;
+}
+
+const char* arena_pages_name(arena_pages_t pages) {
+    switch (pages) {
+        case ARENA_PAGES_HUGETLB: return "explicit huge pages";
+        case ARENA_PAGES_TRANSPARENT: return "transparent huge pages";
+        default: return "normal pages";
+    }
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    return arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+void* arena_alloc_aligned(arena_t* arena, size_t size, size_t align) {
+    if (align < ARENA_ALIGN) align = ARENA_ALIGN;
+    size_t offset = (arena->used + align - 1) & ~(align - 1);
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (offset > arena->size || arena->size - offset < size) return NULL;
+
+    // Pages no level touched yet are still zero from the kernel, only the ones an earlier level used are cleared
+    unsigned char* ptr = arena->base + offset;
+    if (offset < arena->peak) {
+        memset(ptr, 0, (offset + size < arena->peak ? offset + size : arena->peak) - offset);
+    }
+    arena->used = offset + size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return ptr;
+}
+
+char* arena_strndup(arena_t* arena, const char* str, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_reset(arena_t* arena) {
+    arena->used = 0;
+}
+
+void arena_destroy(arena_t* arena) {
+    if (arena->base != NULL) munmap(arena->base, arena->size);
+    memset(arena, 0, sizeof(*arena));
+}
+
+// Helper private function telling whether the kernel hands out transparent huge pages to a mapping that
+// asked for them, it may be built with them but have them turned off
+static int transparent_enabled() {
+    FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (file == NULL) return 0;
+    char mode[128];
+    int enabled = fgets(mode, sizeof(mode), file) != NULL && strstr(mode, "[never]") == NULL;
+    fclose(file);
+    return enabled;
+}
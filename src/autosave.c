@@ -0,0 +1,270 @@
+#include "autosave.h"
+#include "snapshot.h"
+#include "histogram.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+typedef struct {
+    unsigned char* data;            // autosave_header_t followed by the snapshot
+    size_t size;
+    size_t capacity;
+} save_buffer_t;
+
+static void* writer_thread(void* arg);
+static int write_file(const save_buffer_t* buffer);
+
+static char save_path[MAX_FILENAME];
+static char temp_path[MAX_FILENAME + 4];
+static char dir_path[MAX_FILENAME];  // directory holding both, synced after the rename
+static save_buffer_t buffers[2];    // one is filled by the UI thread while the other is written
+static int pending = -1;            // buffer waiting for the writer, -1 if none
+static int writing = -1;            // buffer the writer is writing, -1 if idle
+static int running = 0;
+
+static pthread_t writer_tid;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;      // a buffer is pending or the writer must stop
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;      // the writer finished a buffer
+
+// Written by the writer thread under 'mutex'
+static histogram_t latency;         // ns from open to rename of each autosave
+static long saves = 0;
+static long failures = 0;
+static size_t last_size = 0;
+
+
+int autosave_start(const char* path) {
+    snprintf(save_path, sizeof(save_path), "%s", path);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", save_path);
+    char* slash = strrchr(save_path, '/');
+    if (slash == NULL) {
+        snprintf(dir_path, sizeof(dir_path), ".");
+    } else {
+        snprintf(dir_path, sizeof(dir_path), "%.*s", slash == save_path ? 1 : (int)(slash - save_path), save_path);
+    }
+    hist_reset(&latency);
+
+    running = 1;
+    if (pthread_create(&writer_tid, NULL, writer_thread, NULL) != 0) {
+        debug("Error creating autosave thread\n");
+        running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void autosave_submit(const board_t* board) {
+    if (!running) return;
+
+    // The pending buffer is stale already, otherwise take the one the writer is not using
+    pthread_mutex_lock(&mutex);
+    int b = pending >= 0 ? pending : (writing == 0 ? 1 : 0);
+    pending = -1;
+    pthread_mutex_unlock(&mutex);
+
+    save_buffer_t* buffer = &buffers[b];
+    size_t snapshot_bytes = snapshot_size(board);
+    size_t size = sizeof(autosave_header_t) + snapshot_bytes;
+    if (size > buffer->capacity) {
+        unsigned char* data = realloc(buffer->data, size);
+        if (data == NULL) {
+            debug("Autosave: cannot allocate %zu bytes\n", size);
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = size;
+    }
+
+    autosave_header_t* header = (autosave_header_t*)buffer->data;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, AUTOSAVE_MAGIC, sizeof(header->magic));
+    header->version = AUTOSAVE_VERSION;
+    header->seed = board->opts->seed;
+    header->level = board->current_level;
+    memcpy(header->level_file, board->level_file, sizeof(header->level_file));
+    header->total_turns = board->total_turns;
+    header->snapshot_size = snapshot_bytes;
+    snapshot_encode(board, header + 1);
+    buffer->size = size;
+
+    pthread_mutex_lock(&mutex);
+    pending = b;
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&mutex);
+}
+
+void autosave_wait() {
+    if (!running) return;
+
+    pthread_mutex_lock(&mutex);
+    while (pending >= 0 || writing >= 0) {
+        pthread_cond_wait(&idle, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+int autosave_restart_after_fork() {
+    if (!running) return 0;
+
+    // autosave_wait ran before the fork, the dead writer held nothing
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&work, NULL);
+    pthread_cond_init(&idle, NULL);
+    pending = -1;
+    writing = -1;
+    if (pthread_create(&writer_tid, NULL, writer_thread, NULL) != 0) {
+        debug("Error recreating autosave thread\n");
+        running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void autosave_stop() {
+    if (!running) return;
+
+    pthread_mutex_lock(&mutex);
+    running = 0;
+    pthread_cond_signal(&work);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(writer_tid, NULL);
+
+    for (int i = 0; i < 2; i++) {
+        free(buffers[i].data);
+        buffers[i].data = NULL;
+        buffers[i].capacity = 0;
+    }
+}
+
+void autosave_discard() {
+    if (save_path[0] == '\0') return;
+    autosave_wait();
+    if (unlink(save_path) == 0) debug("Autosave: removed %s, the game is over\n", save_path);
+}
+
+void* autosave_load(const char* path, autosave_header_t* header) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open autosave %s\n", path);
+        return NULL;
+    }
+
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, AUTOSAVE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != AUTOSAVE_VERSION) {
+        fprintf(stderr, "%s is not an autosave file\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    void* snapshot = malloc(header->snapshot_size);
+    if (snapshot == NULL || fread(snapshot, 1, header->snapshot_size, file) != header->snapshot_size) {
+        fprintf(stderr, "Error reading autosave %s\n", path);
+        free(snapshot);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    header->level_file[sizeof(header->level_file) - 1] = '\0';
+    return snapshot;
+}
+
+void autosave_report(FILE* out) {
+    if (saves == 0 && failures == 0) return;
+
+    fprintf(out, "Autosave: %ld writes (%ld failed) of %zu bytes, latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            saves, failures, last_size, hist_percentile(&latency, 50) / 1e6,
+            hist_percentile(&latency, 99) / 1e6, latency.max / 1e6);
+}
+
+static void* writer_thread(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&mutex);
+    for (;;) {
+        // A pending autosave is still written when the game stops
+        while (pending < 0 && running) {
+            pthread_cond_wait(&work, &mutex);
+        }
+        if (pending < 0) break;
+
+        writing = pending;
+        pending = -1;
+        pthread_mutex_unlock(&mutex);
+
+        long long start_ns = monotonic_ns();
+        int result = write_file(&buffers[writing]);
+        long long elapsed_ns = monotonic_ns() - start_ns;
+
+        pthread_mutex_lock(&mutex);
+        if (result == 0) {
+            hist_record(&latency, elapsed_ns);
+            saves++;
+            last_size = buffers[writing].size;
+            debug("Autosave: turn %ld, %zu bytes in %.3f ms\n",
+                  (long)((autosave_header_t*)buffers[writing].data)->total_turns, last_size, elapsed_ns / 1e6);
+        } else {
+            failures++;
+        }
+        writing = -1;
+        pthread_cond_broadcast(&idle);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+// Helper private function writing a buffer into the temporary file and renaming it over the autosave
+static int write_file(const save_buffer_t* buffer) {
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        debug("Autosave: cannot create %s\n", temp_path);
+        unlink(temp_path);
+        return -1;
+    }
+
+    int result = 0;
+    size_t written = 0;
+    while (result == 0 && written < buffer->size) {
+        ssize_t n = write(fd, buffer->data + written, buffer->size - written);
+        if (n < 0) {
+            debug("Autosave: error writing %s\n", temp_path);
+            result = -1;
+        } else {
+            written += n;
+        }
+    }
+
+    // The data must be on disk before the rename makes it the autosave, the descriptor is closed either way
+    if (result == 0 && fsync(fd) != 0) {
+        debug("Autosave: error syncing %s\n", temp_path);
+        result = -1;
+    }
+    if (close(fd) != 0 && result == 0) {
+        debug("Autosave: error closing %s\n", temp_path);
+        result = -1;
+    }
+    if (result == 0 && rename(temp_path, save_path) != 0) {
+        debug("Autosave: error replacing %s\n", save_path);
+        result = -1;
+    }
+    if (result != 0) {
+        // A failing disk must not leave a partial file behind on every attempt
+        unlink(temp_path);
+        return -1;
+    }
+
+    // The rename is only durable once the directory entry is on disk too
+    int dir_fd = open(dir_path, O_RDONLY);
+    if (dir_fd < 0 || fsync(dir_fd) != 0) {
+        debug("Autosave: error syncing %s\n", dir_path);
+        if (dir_fd >= 0) close(dir_fd);
+        return -1;
+    }
+    close(dir_fd);
+    return 0;
+}
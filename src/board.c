@@ -2,85 +2,108 @@
 #include "parser.h"
 #include "utils.h"
 #include "display.h"
+#include "workers.h"
+#include "bundle.h"
+#include "loader.h"
+#include "replay.h"
+#include "contention.h"
+#include "frame.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "autosave.h"
+#include "journal.h"
+#include "kernels.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <sys/wait.h>
 
 
 static void move_ghost_charged(board_t* board, ghost_t* ghost, char direction);
 static int move_ghost(board_t* board, ghost_t* ghost, int new_x, int new_y);
-static int find_and_kill_pacman(board_t* board, int new_x, int new_y);
-static inline int get_board_index(board_t* board, int x, int y);
+static void move_pacman_cas(board_t* board, pacman_t* pacman, int pacman_id, int new_x, int new_y);
+static int move_ghost_cas(board_t* board, ghost_t* ghost, int new_x, int new_y);
+static int kill_pacman_if_alive(board_t* board, int pacman_id);
+static uint64_t entity_stream(board_t* board, int entity);
+static void handle_menu_key(board_t* board);
 static inline int is_valid_position(board_t* board, int x, int y);
-static inline void finish_play(board_t *board, int *level_state);
-static inline void lock_for_move(board_t* board, int old_index, int new_index);
-static inline void unlock_after_move(board_t* board, int old_index, int new_index);
-
-
-sem_t sem_start_turn;      // Controls start of logic
-sem_t sem_finished_plays;  // Controls end of logic (waiting for UI)
-sem_t sem_render_complete; // Controls end of frame (releasing threads)
+static inline uint32_t get_occupant(board_t* board, int64_t index);
+static inline void set_occupant(board_t* board, int64_t index, uint32_t occupant);
+static inline void merge_play_result(board_t* board, int result);
+static inline void lock_for_move(board_t* board, rng_t* rng, lock_stats_t* stats, int64_t old_index,
+                                 int64_t new_index);
+static inline void count_contention(board_t* board, lock_stats_t* stats, int64_t index, int first_try,
+                                    long long waited_ns);
+static inline void unlock_after_move(board_t* board, int64_t old_index, int64_t new_index);
 
 
 void play_level(board_t* board) {
     debug("UI thread: Starting level\n");
     board->level_result = CONTINUE_PLAY;
 
-    pthread_t pacman_tid;
-    pthread_t ghosts_tid[board->n_ghosts];
-
-    sem_init(&sem_start_turn, 0, 0);
-    sem_init(&sem_finished_plays, 0, 0);
-    sem_init(&sem_render_complete, 0, 0);
-
-    pacman_thread_arg_t pacman_args;
-    ghost_thread_arg_t ghost_args[board->n_ghosts];
-
-    pacman_args.board = board;
-    pacman_args.pacman_id = 0;
-
-    if (pthread_create(&pacman_tid, NULL, pacman_thread, (void*)&pacman_args) != 0) {
-        debug("UI thread: Error creating pacman thread.\n");
-        return;
-    }
+    int n_entities = board->n_pacmans + board->n_ghosts; // pacmans + ghosts
+    int headless = board->opts->headless;
+    int serial = board->opts->engine == ENGINE_SERIAL;
 
-    for (int i = 0; i < board->n_ghosts; i++) {
-        ghost_args[i].board = board;
-        ghost_args[i].ghost_id = i;
-        if (pthread_create(&ghosts_tid[i], NULL, ghost_thread, (void*)&ghost_args[i]) != 0) {
-            debug("UI thread: Error creating ghost thread for ghost %d.\n", i);
+    worker_pool_t pool;
+    if (serial) {
+        debug("UI thread: Starting serial level loop with %d entities.\n", n_entities);
+    } else {
+        if (pool_start(&pool, board, pool_size(board->opts->n_workers, n_entities)) != 0) {
+            debug("UI thread: Error starting worker pool.\n");
             return;
         }
+        debug("UI thread: Starting level loop with %d entities on %d workers.\n", n_entities, pool.n_workers);
     }
 
-    int n_entities = board->n_pacmans + board->n_ghosts; // pacmans + ghosts
-    debug("UI thread: Starting level loop with %d entities.\n", n_entities);
-
-    screen_refresh(board, DRAW_MENU);
+    frame_clock_t clock;
+    if (!headless) {
+        screen_refresh(board, DRAW_MENU);
+        frame_clock_start(&clock, board->tempo_us * 1000LL);
+    }
 
-    while (board->level_result == CONTINUE_PLAY) {
-        sleep_ms(board->tempo);
+    // Profiled phases run from one mark to the next, a zero mark turns the profiler off
+    int profile = board->opts->profile;
+    long long mark = profile ? monotonic_ns() : 0;
 
-        // Release "Start the turn" semaphores to all entity threads
-        for (int i = 0; i < n_entities; i++) {
-            sem_post(&sem_start_turn);
-        }
+    journal_begin_level(board);
 
-        // Wait for everyone to finish moving
-        for (int i = 0; i < n_entities; i++) {
-            sem_wait(&sem_finished_plays);
+    while (board->level_result == CONTINUE_PLAY) {
+        // One turn per tempo, measured from the start of the previous one
+        if (!headless) frame_clock_wait(&clock);
+        prof_lap(&mark, PHASE_FRAME_WAIT);
+
+        journal_begin_turn(board);
+        // Every entity plays once, in order on this thread or split between the workers
+        if (serial && profile) {
+            long long slowest_ns = 0;
+            for (int i = 0; i < n_entities; i++) {
+                long long start_ns = monotonic_ns();
+                entity_play(board, i);
+                long long took_ns = monotonic_ns() - start_ns;
+                if (took_ns > slowest_ns) slowest_ns = took_ns;
+            }
+            prof_record(PHASE_SLOWEST_ENTITY, slowest_ns);
+        } else if (serial) {
+            for (int i = 0; i < n_entities; i++) {
+                entity_play(board, i);
+            }
+        } else {
+            pool_run_turn(&pool);
         }
+        journal_end_turn(board);
+        prof_lap(&mark, PHASE_TURN);
 
-        debug("=== ALL ENTITIES MOVED - RENDERING ===\n");
+        board->total_turns++;
+        debug_hot("=== ALL ENTITIES MOVED - RENDERING ===\n");
 
-        // Safe multithreaded enviorenment, other threads are waiting, no need to use locks
+        // Safe multithreaded enviorenment, workers are waiting at the barrier, no need to use locks
 
         if (board->play_result == CREATE_BACKUP) {
             debug("UI thread: Creating backup...\n");
-            int result = create_backup(board, &pacman_tid, ghosts_tid, &pacman_args, ghost_args);
+            int result = create_backup(board, serial ? NULL : &pool);
             board->play_result = CONTINUE;
 
             if (result == -1) {
@@ -90,286 +113,357 @@ void play_level(board_t* board) {
                 debug("UI thread: Backup instance created\n"); 
                 continue; // Restart the loop with fresh state
             }
+            // The parent slept while the backup instance played, its missed frames are not owed
+            if (!headless) frame_clock_start(&clock, board->tempo_us * 1000LL);
 
         } else if (board->play_result == REACHED_PORTAL) {
             debug("UI thread: Level completed, moving to next level\n");
             board->level_result = NEXT_LEVEL;
         } else if (board->play_result == DEAD_PACMAN) {
-            debug("UI thread: Pacman is dead, quitting game\n");
-            board->level_result = QUIT_GAME;
+            int slot = board->opts->backup == BACKUP_SNAPSHOT ? snapshot_latest(board) : -1;
+            if (slot >= 0 && snapshot_restore(board, slot) == 0) {
+                // Like the backup process, a quicksave brings the pacman back only once
+                debug("UI thread: Pacman is dead, resuming from snapshot slot %d\n", slot + 1);
+                snapshot_drop(slot);
+                journal_clear();
+                board->play_result = CONTINUE;
+            } else {
+                debug("UI thread: Pacman is dead, quitting game\n");
+                board->level_result = QUIT_GAME;
+            }
         } else if (board->play_result == QUIT_PRESSED) {
             debug("UI thread: User forced quit, quitting game\n");
             board->level_result = QUIT_GAME_FORCED;
         }
 
-        board->pacmans[0].ui_key = get_input();
-        debug("UI thread: Got input %c\n", board->pacmans[0].ui_key);
+        if (board->level_result == CONTINUE_PLAY && board->opts->max_turns > 0 &&
+            board->total_turns >= board->opts->max_turns) {
+            debug("UI thread: Turn limit of %ld reached, stopping game\n", board->opts->max_turns);
+            board->level_result = TURN_LIMIT_REACHED;
+        }
+        if (board->level_result == CONTINUE_PLAY && replay_ended(board->total_turns)) {
+            debug("UI thread: Replay ended at turn %ld, stopping game\n", board->total_turns);
+            board->level_result = TURN_LIMIT_REACHED;
+        }
+        if (board->level_result == CONTINUE_PLAY && board->opts->autosave_path != NULL &&
+            board->total_turns % board->opts->autosave_every == 0) {
+            autosave_submit(board);
+        }
 
-        screen_refresh(board, DRAW_MENU);
+        prof_lap(&mark, PHASE_RESULT);
 
-        debug("\n");
+        if (headless) {
+            // Scripted pacmans play on their own, user controlled ones replay the recorded keys or stand still
+            board->pacmans[0].ui_key = replay_key(board->total_turns);
+            handle_menu_key(board);
+            prof_lap(&mark, PHASE_INPUT);
+        } else {
+            board->pacmans[0].ui_key = get_input();
+            record_key(board->total_turns, board->pacmans[0].ui_key);
+            debug_hot("UI thread: Got input %c\n", board->pacmans[0].ui_key);
+            handle_menu_key(board);
+            prof_lap(&mark, PHASE_INPUT);
 
-        sleep_ms(board->tempo);
+            screen_refresh(board, DRAW_MENU);
+            prof_lap(&mark, PHASE_RENDER);
 
+            debug_hot("\n");
+        }
 
-        // Unlock threads to play next turn, unsafe enviorenment
+        if (profile) prof_poll();
+        debug_hot("=== RENDER COMPLETE - NEW PLAY ===\n");
+    }
 
-        debug("=== RENDER COMPLETE - RELEASING - NEW PLAY ===\n");
+    if (!serial) pool_stop(&pool);
 
-        // Release threads to complete the loop
-        for (int i = 0; i < n_entities; i++) {
-            sem_post(&sem_render_complete);
-        }
-    }
-    
-    pthread_join(pacman_tid, NULL);
-    for (int i = 0; i < board->n_ghosts; i++) {
-        pthread_join(ghosts_tid[i], NULL);
-    }
+    if (board->opts->contention) contention_report(board);
 
-    sem_destroy(&sem_finished_plays);
-    sem_destroy(&sem_start_turn);
-    sem_destroy(&sem_render_complete);
+    long frames, cells;
+    take_render_stats(&frames, &cells);
+    if (frames > 0) {
+        debug("Level %d: %ld frames, %.1f cells drawn per frame, %ld of %ld tiles allocated\n", board->current_level,
+              frames, (double)cells / frames, board->n_tiles, (long)board->tiles_x * board->tiles_y);
+    }
 
     return;
 }
 
-void* pacman_thread(void* arg) {
-    pacman_thread_arg_t* args = (pacman_thread_arg_t*)arg;
-    board_t* board = args->board;
-    pacman_t* pacman = &board->pacmans[args->pacman_id];
-
-    debug("Pacman %d thread started.\n", args->pacman_id);
+void entity_play(board_t* board, int entity) {
+    if (entity < board->n_pacmans) {
+        pacman_play(board, entity);
+    } else if (journal_recording()) {
+        // Only this thread touches the ghost, its pre-image is taken here rather than by the UI thread
+        journal_entity_t pre;
+        journal_capture(board, entity, &pre);
+        ghost_play(board, entity - board->n_pacmans);
+        journal_ghost_played(board, &pre);
+    } else {
+        ghost_play(board, entity - board->n_pacmans);
+    }
+}
 
-    int level_state = board->level_result;
+void pacman_play(board_t* board, int pacman_id) {
+    pacman_t* pacman = &board->pacmans[pacman_id];
     command_t* play;
     command_t c; 
 
-    while (level_state == CONTINUE_PLAY) {
-        sem_wait(&sem_start_turn);
+    debug_hot("Pacman %d: RUNNING - KEY %c\n", pacman_id, pacman->ui_key);
+    if (pacman->waiting > 0) {
+        pacman->waiting -= 1;
+        return;
+    }
+    pacman->waiting = pacman->passo;
+
+    if (pacman->n_moves == 0) { // if is user input
+        c.command = pacman->ui_key;
 
-        debug("Pacman thread: RUNNING - KEY %c\n", pacman->ui_key);
-        if (pacman->waiting > 0) {
-            pacman->waiting -= 1;
-            finish_play(board, &level_state);
-            continue;
+        if(c.command == '\0') {
+            return;
+        } else if (c.command == 'G' || c.command == 'Q') { 
+            merge_play_result(board, c.command == 'G' ? CREATE_BACKUP : QUIT_PRESSED);
+            return;
         }
-        pacman->waiting = pacman->passo;
-
-        if (pacman->n_moves == 0) { // if is user input
-            c.command = pacman->ui_key;
-
-            if(c.command == '\0') {
-                finish_play(board, &level_state);
-                continue;
-            } else if (c.command == 'G' || c.command == 'Q') { 
-                pthread_rwlock_wrlock(&board->play_res_rwlock);
-                if (c.command == 'G' && board->play_result == CONTINUE) {
-                    board->play_result = CREATE_BACKUP;
-                } else if (c.command == 'Q') {
-                    board->play_result = QUIT_PRESSED;
-                }
-                pthread_rwlock_unlock(&board->play_res_rwlock);
-
-                finish_play(board, &level_state);
-                continue;
+
+        c.turns = 1;
+        play = &c;
+    }
+    else {
+        play = &pacman->moves[pacman->current_move%pacman->n_moves];
+    }
+
+    int new_x = pacman->pos_x;
+    int new_y = pacman->pos_y;
+
+    char direction = play->command;
+
+    if (direction == 'R') {
+        char directions[] = {'W', 'S', 'A', 'D'};
+        direction = directions[rng_below(&pacman->rng, 4)];
+    }
+
+    switch (direction) {
+        case 'W': // Up
+            new_y--;
+            break;
+        case 'S': // Down
+            new_y++;
+            break;
+        case 'A': // Left
+            new_x--;
+            break;
+        case 'D': // Right
+            new_x++;
+            break;
+        case 'T': // Wait
+            if (play->turns_left == 1) {
+                pacman->current_move += 1;
+                play->turns_left = play->turns;
             }
+            else play->turns_left -= 1;
+            return;
+        default:
+            return; // Invalid direction
+    }
 
-            c.turns = 1;
-            play = &c;
-        }
-        else {
-            play = &pacman->moves[pacman->current_move%pacman->n_moves];
-        }
+    // Logic for the auto movement
+    pacman->current_move+=1;
+
+    if (!is_valid_position(board, new_x, new_y)) {
+        return;
+    }
 
-        int new_x = pacman->pos_x;
-        int new_y = pacman->pos_y;
+    // Walls never change and may have no tile to lock, they are checked before taking any lock
+    int64_t new_index = cell_index(board, new_x, new_y);
+    if (test_cell(board, PLANE_WALLS, new_index)) {
+        return;
+    }
 
-        char direction = play->command;
+    if (board->opts->locking == LOCKING_CAS) {
+        move_pacman_cas(board, pacman, pacman_id, new_x, new_y);
+        return;
+    }
 
-        if (direction == 'R') {
-            char directions[] = {'W', 'S', 'A', 'D'};
-            direction = directions[rand() % 4];
-        }
+    int64_t old_index = cell_index(board, pacman->pos_x, pacman->pos_y);
+    lock_for_move(board, &pacman->rng, &pacman->lock_stats, old_index, new_index);
 
-        switch (direction) {
-            case 'W': // Up
-                new_y--;
-                break;
-            case 'S': // Down
-                new_y++;
-                break;
-            case 'A': // Left
-                new_x--;
-                break;
-            case 'D': // Right
-                new_x++;
-                break;
-            case 'T': // Wait
-                if (play->turns_left == 1) {
-                    pacman->current_move += 1;
-                    play->turns_left = play->turns;
-                }
-                else play->turns_left -= 1;
-                finish_play(board, &level_state);
-                continue;
-            default:
-                finish_play(board, &level_state);
-                continue; // Invalid direction
-        }
+    // Ensure pacman still alive after locks acquired
+    if (!atomic_load(&pacman->alive)) {
+        unlock_after_move(board, old_index, new_index);
+        return;
+    }
 
-        // Logic for the auto movement
-        pacman->current_move+=1;
+    uint32_t target_occupant = get_occupant(board, new_index);
 
-        if (!is_valid_position(board, new_x, new_y)) {
-            finish_play(board, &level_state);
-            continue;
-        }
+    if (test_cell(board, PLANE_PORTALS, new_index)) {
+        set_occupant(board, old_index, OCC_EMPTY);
+        set_occupant(board, new_index, OCC_PACMAN | pacman_id);
+        mark_dirty(board, old_index);
+        mark_dirty(board, new_index);
+        merge_play_result(board, REACHED_PORTAL);
+        unlock_after_move(board, old_index, new_index);
+        return;
+    }
 
-        int new_index = get_board_index(board, new_x, new_y);
-        int old_index = get_board_index(board, pacman->pos_x, pacman->pos_y);
-        lock_for_move(board, old_index, new_index);
+    // Check for ghosts
+    if (target_occupant & OCC_GHOST) {
+        kill_pacman(board, pacman_id);
+        merge_play_result(board, DEAD_PACMAN);
+        unlock_after_move(board, old_index, new_index);
+        return;
+    }
 
-        // Ensure pacman still alive after locks acquired
-        if (!pacman->alive) {
-            unlock_after_move(board, old_index, new_index);
-            finish_play(board, &level_state);
-            continue;
-        }
+    // Collect points
+    if (test_cell(board, PLANE_DOTS, new_index)) {
+        pacman->points++;
+        clear_cell(board, PLANE_DOTS, new_index);
+        journal_dot(pacman_id, new_index);
+    }
 
-        char target_content = board->board[new_index].content;
+    // Update board
+    pacman->pos_x = new_x;
+    pacman->pos_y = new_y;
 
-        if (board->board[new_index].has_portal) {
-            board->board[old_index].content = ' ';
-            board->board[new_index].content = 'P';
-            pthread_rwlock_wrlock(&board->play_res_rwlock);
-            board->play_result = REACHED_PORTAL;
-            pthread_rwlock_unlock(&board->play_res_rwlock);
-            unlock_after_move(board, old_index, new_index);
-            finish_play(board, &level_state);
-            continue;
-        }
+    set_occupant(board, old_index, OCC_EMPTY);
+    set_occupant(board, new_index, OCC_PACMAN | pacman_id);
+    mark_dirty(board, old_index);
+    mark_dirty(board, new_index);
 
-        // Check for walls
-        if (target_content == 'W') {
-            unlock_after_move(board, old_index, new_index);
-            finish_play(board, &level_state);
-            continue;
-        }
+    unlock_after_move(board, old_index, new_index);
+}
 
-        // Check for ghosts
-        if (target_content == 'M') {
-            kill_pacman(board, args->pacman_id);
-            pthread_rwlock_wrlock(&board->play_res_rwlock);
-            board->play_result = DEAD_PACMAN;
-            pthread_rwlock_unlock(&board->play_res_rwlock);
-            unlock_after_move(board, old_index, new_index);
-            finish_play(board, &level_state);
-            continue;
+/*
+Lock-free move: the pacman first claims the target cell with a CAS from OCC_EMPTY, then releases the
+cell it stands on with a CAS from its own id. A ghost that walks into the pacman replaces its id in
+the occupancy with a CAS, so when the release fails the pacman was eaten before it left and it gives
+the target cell back. The rules are those of the locked move: a portal is reached whoever stands on it,
+then a ghost kills the pacman, then the dot is eaten.
+*/
+static void move_pacman_cas(board_t* board, pacman_t* pacman, int pacman_id, int new_x, int new_y) {
+    if (!atomic_load(&pacman->alive)) return;
+
+    int64_t new_index = cell_index(board, new_x, new_y);
+    int64_t old_index = cell_index(board, pacman->pos_x, pacman->pos_y);
+    uint32_t me = OCC_PACMAN | pacman_id;
+
+    if (board->opts->contention) pacman->lock_stats.moves++;
+
+    // Like the locked move, the pacman takes the portal cell over without eating its dot or moving there
+    if (test_cell(board, PLANE_PORTALS, new_index)) {
+        uint32_t expected = me;
+        if (!atomic_compare_exchange_strong_explicit(cell_occupancy(board, old_index), &expected, OCC_EMPTY,
+                                                     memory_order_acq_rel, memory_order_acquire)) {
+            return; // eaten before it left
         }
+        atomic_store_explicit(cell_occupancy(board, new_index), me, memory_order_release);
+        mark_dirty(board, old_index);
+        mark_dirty(board, new_index);
+        merge_play_result(board, REACHED_PORTAL);
+        return;
+    }
 
-        // Collect points
-        if (board->board[new_index].has_dot) {
-            pacman->points++;
-            board->board[new_index].has_dot = 0;
+    uint32_t occupant = OCC_EMPTY;
+    int first_try = 1;
+    while (!atomic_compare_exchange_weak_explicit(cell_occupancy(board, new_index), &occupant, me,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+        if (board->opts->contention) {
+            count_contention(board, &pacman->lock_stats, new_index, first_try, 0);
+            first_try = 0;
         }
+        if (occupant & OCC_GHOST) {
+            kill_pacman(board, pacman_id);
+            merge_play_result(board, DEAD_PACMAN);
+            return;
+        }
+        if (occupant != OCC_EMPTY) return; // another pacman
+    }
 
-        // Update board
-        pacman->pos_x = new_x;
-        pacman->pos_y = new_y;
-
-        board->board[old_index].content = ' ';
-        board->board[new_index].content = 'P';
+    uint32_t expected = me;
+    if (!atomic_compare_exchange_strong_explicit(cell_occupancy(board, old_index), &expected, OCC_EMPTY,
+                                                 memory_order_acq_rel, memory_order_acquire)) {
+        expected = me;
+        atomic_compare_exchange_strong_explicit(cell_occupancy(board, new_index), &expected, OCC_EMPTY,
+                                                memory_order_acq_rel, memory_order_acquire);
+        mark_dirty(board, new_index);
+        return;
+    }
 
-        unlock_after_move(board, old_index, new_index);
-        finish_play(board, &level_state);
+    // Only this pacman ever eats the dots
+    if (test_cell(board, PLANE_DOTS, new_index)) {
+        pacman->points++;
+        clear_cell(board, PLANE_DOTS, new_index);
+        journal_dot(pacman_id, new_index);
     }
 
-    return NULL;
+    pacman->pos_x = new_x;
+    pacman->pos_y = new_y;
+    mark_dirty(board, old_index);
+    mark_dirty(board, new_index);
 }
 
-void* ghost_thread(void* arg) {
-    ghost_thread_arg_t* args = (ghost_thread_arg_t*)arg;
-    board_t* board = args->board;
-    int ghost_id = args->ghost_id;
+void ghost_play(board_t* board, int ghost_id) {
     ghost_t* ghost = &board->ghosts[ghost_id];
-
-    debug("Ghost %d thread started.\n", ghost_id);
-
-    int level_state = board->level_result;
     command_t* play;
 
-    while (level_state == CONTINUE_PLAY) {
-        sem_wait(&sem_start_turn);
-        debug("Ghost %d thread: RUNNING\n", ghost_id);
+    debug_hot("Ghost %d: RUNNING\n", ghost_id);
 
-        if (ghost->waiting > 0) {
-            ghost->waiting -= 1;
-            finish_play(board, &level_state);
-            continue;
-        }
-        ghost->waiting = ghost->passo;
+    if (ghost->waiting > 0) {
+        ghost->waiting -= 1;
+        return;
+    }
+    ghost->waiting = ghost->passo;
 
-        play = &ghost->moves[ghost->current_move%ghost->n_moves];
+    play = &ghost->moves[ghost->current_move%ghost->n_moves];
 
-        int new_x = ghost->pos_x;
-        int new_y = ghost->pos_y;
+    int new_x = ghost->pos_x;
+    int new_y = ghost->pos_y;
 
-        char direction = play->command;
+    char direction = play->command;
 
-         if (direction == 'R') {
-            char directions[] = {'W', 'S', 'A', 'D'};
-            direction = directions[rand() % 4];
-        }
+    if (direction == 'R') {
+        char directions[] = {'W', 'S', 'A', 'D'};
+        direction = directions[rng_below(&ghost->rng, 4)];
+    }
 
-        debug("Ghost %d thread: KEY %c\n", ghost_id, play->command);
-
-        // Calculate new position based on direction
-        switch (direction) {
-            case 'W': // Up
-                new_y--;
-                break;
-            case 'S': // Down
-                new_y++;
-                break;
-            case 'A': // Left
-                new_x--;
-                break;
-            case 'D': // Right
-                new_x++;
-                break;
-            case 'C': // Charge
-                ghost->current_move += 1;
-                ghost->charged = 1;
-                finish_play(board, &level_state);
-                continue;
-            case 'T': // Wait
-                if (play->turns_left == 1) {
-                    ghost->current_move += 1; // move on
-                    play->turns_left = play->turns;
-                }
-                else play->turns_left -= 1;
-                finish_play(board, &level_state);
-                continue;
-            default:
-                finish_play(board, &level_state);
-                continue; // Invalid direction
-        }
+    debug_hot("Ghost %d: KEY %c\n", ghost_id, play->command);
 
-        // Logic for the WASD movement
-        ghost->current_move++;
-        if (ghost->charged) {
-            move_ghost_charged(board, ghost, direction);
-            finish_play(board, &level_state);
-            continue;
-        }
+    // Calculate new position based on direction
+    switch (direction) {
+        case 'W': // Up
+            new_y--;
+            break;
+        case 'S': // Down
+            new_y++;
+            break;
+        case 'A': // Left
+            new_x--;
+            break;
+        case 'D': // Right
+            new_x++;
+            break;
+        case 'C': // Charge
+            ghost->current_move += 1;
+            ghost->charged = 1;
+            mark_dirty(board, cell_index(board, ghost->pos_x, ghost->pos_y));
+            return;
+        case 'T': // Wait
+            if (play->turns_left == 1) {
+                ghost->current_move += 1; // move on
+                play->turns_left = play->turns;
+            }
+            else play->turns_left -= 1;
+            return;
+        default:
+            return; // Invalid direction
+    }
 
-        move_ghost(board, ghost, new_x, new_y);
-        
-        finish_play(board, &level_state);
+    // Logic for the WASD movement
+    ghost->current_move++;
+    if (ghost->charged) {
+        move_ghost_charged(board, ghost, direction);
+        return;
     }
 
-    return NULL;
+    move_ghost(board, ghost, new_x, new_y);
 }
 
 static void move_ghost_charged(board_t* board, ghost_t* ghost, char direction) {
@@ -379,6 +473,7 @@ static void move_ghost_charged(board_t* board, ghost_t* ghost, char direction) {
     int dy = 0;
 
     ghost->charged = 0;
+    mark_dirty(board, cell_index(board, ghost->pos_x, ghost->pos_y));
 
     switch (direction) {
         case 'W': dy = -1; break;
@@ -403,46 +498,233 @@ static int move_ghost(board_t* board, ghost_t* ghost, int new_x, int new_y) {
         return INVALID_MOVE;
     }
 
-    int new_index = get_board_index(board, new_x, new_y);
-    int old_index = get_board_index(board, ghost->pos_x, ghost->pos_y);
-    lock_for_move(board, old_index, new_index);
+    // Walls never change and may have no tile to lock, they are checked before taking any lock
+    int64_t new_index = cell_index(board, new_x, new_y);
+    if (test_cell(board, PLANE_WALLS, new_index)) {
+        return INVALID_MOVE;
+    }
+
+    if (board->opts->locking == LOCKING_CAS) {
+        return move_ghost_cas(board, ghost, new_x, new_y);
+    }
+
+    int ghost_id = (int)(ghost - board->ghosts);
+
+    int64_t old_index = cell_index(board, ghost->pos_x, ghost->pos_y);
+    lock_for_move(board, &ghost->rng, &ghost->lock_stats, old_index, new_index);
 
-    char target_content = board->board[new_index].content;
+    uint32_t target_occupant = get_occupant(board, new_index);
 
-    // Check for walls and ghosts
-    if (target_content == 'W' || target_content == 'M') {
+    // Check for ghosts
+    if (target_occupant & OCC_GHOST) {
         unlock_after_move(board, old_index, new_index);
         return INVALID_MOVE;
     }
 
-    if (target_content == 'P') {
-        int result = find_and_kill_pacman(board, new_x, new_y);
-        pthread_rwlock_wrlock(&board->play_res_rwlock);
-        board->play_result = result;
-        pthread_rwlock_unlock(&board->play_res_rwlock);
+    if (target_occupant & OCC_PACMAN) {
+        merge_play_result(board, kill_pacman_if_alive(board, target_occupant & OCC_ID_MASK));
     }
 
     // Update board
     ghost->pos_x = new_x;
     ghost->pos_y = new_y;
 
-    board->board[old_index].content = ' ';
-    board->board[new_index].content = 'M';
+    set_occupant(board, old_index, OCC_EMPTY);
+    set_occupant(board, new_index, OCC_GHOST | ghost_id);
+    mark_dirty(board, old_index);
+    mark_dirty(board, new_index);
 
     unlock_after_move(board, old_index, new_index);
     return VALID_MOVE;
 }
 
+// Lock-free move, see move_pacman_cas. Ghosts never enter a ghost's cell, so the release is a plain store.
+static int move_ghost_cas(board_t* board, ghost_t* ghost, int new_x, int new_y) {
+    int ghost_id = (int)(ghost - board->ghosts);
+    int64_t new_index = cell_index(board, new_x, new_y);
+    int64_t old_index = cell_index(board, ghost->pos_x, ghost->pos_y);
+    uint32_t me = OCC_GHOST | ghost_id;
+
+    if (board->opts->contention) ghost->lock_stats.moves++;
+    uint32_t occupant = get_occupant(board, new_index);
+    int first_try = 1;
+    while (!(occupant & OCC_GHOST) &&
+           !atomic_compare_exchange_weak_explicit(cell_occupancy(board, new_index), &occupant, me,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+        if (board->opts->contention) {
+            count_contention(board, &ghost->lock_stats, new_index, first_try, 0);
+            first_try = 0;
+        }
+    }
+    if (occupant & OCC_GHOST) return INVALID_MOVE;
+
+    // The pacman's id was replaced, it finds out when it fails to leave its cell
+    if (occupant & OCC_PACMAN) {
+        pacman_t* pacman = &board->pacmans[occupant & OCC_ID_MASK];
+        if (atomic_exchange(&pacman->alive, 0)) {
+            debug("Killing %d pacman\n\n", (int)(occupant & OCC_ID_MASK));
+            merge_play_result(board, DEAD_PACMAN);
+        }
+    }
+
+    atomic_store_explicit(cell_occupancy(board, old_index), OCC_EMPTY, memory_order_release);
+    ghost->pos_x = new_x;
+    ghost->pos_y = new_y;
+    mark_dirty(board, old_index);
+    mark_dirty(board, new_index);
+    return VALID_MOVE;
+}
+
+void board_row(const board_t* board, int y, char* out) {
+    static const char glyphs[4] = {' ', 'W', ' ', ' '};
+    tile_t* const* tiles = &board->tiles[(int64_t)(y >> TILE_SHIFT) * board->tiles_x];
+    int row = y & TILE_MASK;
+
+    for (int tx = 0; tx < board->tiles_x; tx++) {
+        char* cells = out + tx * TILE_SIZE;
+        int n = board->width - tx * TILE_SIZE < TILE_SIZE ? board->width - tx * TILE_SIZE : TILE_SIZE;
+        const tile_t* tile = tiles[tx];
+        if (tile == NULL) {
+            memset(cells, glyphs[1], n);
+            continue;
+        }
+
+        expand_row(&tile->planes[PLANE_WALLS][row], &tile->planes[PLANE_PORTALS][row], &tile->planes[PLANE_DOTS][row],
+                   n, glyphs, cells);
+        // The entities go over the map
+        const _Atomic uint32_t* occupancy = &tile->occupancy[row * TILE_SIZE];
+        for (int x = 0; x < n; x++) {
+            uint32_t occupant = atomic_load_explicit(&occupancy[x], memory_order_relaxed);
+            if (occupant & OCC_PACMAN) cells[x] = 'P';
+            else if (occupant & OCC_GHOST) cells[x] = 'M';
+        }
+    }
+}
+
+long count_dots(const board_t* board) {
+    // The cells of a tile past the edge of the board are walls, they never have a dot
+    long dots = 0;
+    for (long i = 0; i < board->n_tiles; i++) {
+        dots += (long)count_bits(board->tile_list[i]->planes[PLANE_DOTS], TILE_SIZE);
+    }
+    return dots;
+}
+
+uint64_t board_hash(const board_t* board) {
+    // FNV-1a over the dump of the board and the pacman's points
+    uint64_t hash = 14695981039346656037ULL;
+    char* row = malloc((size_t)board->tiles_x * TILE_SIZE);
+    for (int y = 0; y < board->height; y++) {
+        board_row(board, y, row);
+        for (int x = 0; x < board->width; x++) {
+            hash = (hash ^ (unsigned char)row[x]) * 1099511628211ULL;
+        }
+    }
+    free(row);
+    for (int i = 0; i < board->n_pacmans; i++) {
+        hash = (hash ^ (uint32_t)board->pacmans[i].points) * 1099511628211ULL;
+    }
+    return hash;
+}
+
 void kill_pacman(board_t* board, int pacman_index) {
     debug("Killing %d pacman\n\n", pacman_index);
     pacman_t* pac = &board->pacmans[pacman_index];
-    int index = pac->pos_y * board->width + pac->pos_x;
+    int64_t index = cell_index(board, pac->pos_x, pac->pos_y);
 
-    // Remove pacman from the board
-    board->board[index].content = ' ';
+    // Remove pacman from the board, unless a ghost already took its place
+    uint32_t expected = OCC_PACMAN | pacman_index;
+    atomic_compare_exchange_strong_explicit(cell_occupancy(board, index), &expected, OCC_EMPTY,
+                                            memory_order_acq_rel, memory_order_relaxed);
+    mark_dirty(board, index);
 
     // Mark pacman as dead
-    pac->alive = 0;
+    atomic_store(&pac->alive, 0);
+}
+
+int alloc_tiles(board_t* board) {
+    board->tiles_x = (board->width + TILE_MASK) >> TILE_SHIFT;
+    board->tiles_y = (board->height + TILE_MASK) >> TILE_SHIFT;
+    board->tiles = arena_alloc(&board->arena, (size_t)board->tiles_x * board->tiles_y * sizeof(tile_t*));
+    board->tile_list = NULL;
+    board->n_tiles = 0;
+    board->tile_capacity = 0;
+    return board->tiles == NULL ? -1 : 0;
+}
+
+tile_t* ensure_tile(board_t* board, int64_t index) {
+    int64_t id = index >> (2 * TILE_SHIFT);
+    if (board->tiles[id] != NULL) return board->tiles[id];
+
+    if (board->n_tiles == board->tile_capacity) {
+        // The list moves to twice the room, the old copy stays behind in the arena until the level ends
+        long capacity = board->tile_capacity > 0 ? board->tile_capacity * 2 : 64;
+        tile_t** list = arena_alloc(&board->arena, capacity * sizeof(tile_t*));
+        if (list == NULL) return NULL;
+        if (board->n_tiles > 0) memcpy(list, board->tile_list, board->n_tiles * sizeof(tile_t*));
+        board->tile_list = list;
+        board->tile_capacity = capacity;
+    }
+
+    tile_t* tile = arena_alloc(&board->arena, sizeof(tile_t));
+    if (tile == NULL) return NULL;
+    memset(tile->planes[PLANE_WALLS], 0xff, sizeof(tile->planes[PLANE_WALLS]));
+    tile->tile_x = (int)(id % board->tiles_x);
+    tile->tile_y = (int)(id / board->tiles_x);
+
+    board->tiles[id] = tile;
+    board->tile_list[board->n_tiles++] = tile;
+    return tile;
+}
+
+void rebuild_occupancy(board_t* board) {
+    // Only the cells the entities leave or enter are redrawn, not the whole screen
+    for (long t = 0; t < board->n_tiles; t++) {
+        tile_t* tile = board->tile_list[t];
+        int64_t first = ((int64_t)tile->tile_y * board->tiles_x + tile->tile_x) << (2 * TILE_SHIFT);
+        for (int i = 0; i < TILE_CELLS; i++) {
+            if (atomic_load_explicit(&tile->occupancy[i], memory_order_relaxed) != OCC_EMPTY) {
+                atomic_store_explicit(&tile->occupancy[i], OCC_EMPTY, memory_order_relaxed);
+                mark_dirty(board, first + i);
+            }
+        }
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        const ghost_t* ghost = &board->ghosts[i];
+        int64_t index = cell_index(board, ghost->pos_x, ghost->pos_y);
+        set_occupant(board, index, OCC_GHOST | i);
+        mark_dirty(board, index);
+    }
+    for (int i = 0; i < board->n_pacmans; i++) {
+        const pacman_t* pacman = &board->pacmans[i];
+        if (atomic_load(&pacman->alive)) {
+            int64_t index = cell_index(board, pacman->pos_x, pacman->pos_y);
+            set_occupant(board, index, OCC_PACMAN | i);
+            mark_dirty(board, index);
+        }
+    }
+}
+
+void restore_dots(board_t* board, const uint64_t* dots) {
+    for (long t = 0; t < board->n_tiles; t++, dots += TILE_SIZE) {
+        tile_t* tile = board->tile_list[t];
+        uint64_t* plane = tile->planes[PLANE_DOTS];
+        int64_t first = ((int64_t)tile->tile_y * board->tiles_x + tile->tile_x) << (2 * TILE_SHIFT);
+
+        for (size_t w = next_diff(plane, dots, TILE_SIZE, 0); w < TILE_SIZE; w = next_diff(plane, dots, TILE_SIZE, w + 1)) {
+            uint64_t changed = plane[w] ^ dots[w];
+            plane[w] = dots[w];
+            while (changed != 0) {
+                mark_dirty(board, first + (int64_t)w * TILE_SIZE + __builtin_ctzll(changed));
+                changed &= changed - 1;
+            }
+        }
+    }
+}
+
+// Helper private function for the random stream of an entity, the same entity gets the same stream in every run
+static uint64_t entity_stream(board_t* board, int entity) {
+    return ((uint64_t)board->current_level << 32) | (uint32_t)entity;
 }
 
 // Static Loading
@@ -452,19 +734,33 @@ int load_pacman(board_t* board, int points) {
     // Initialize defaults
     pacman->pos_x = 0;
     pacman->pos_y = 0;
-    pacman->alive = 1;
+    atomic_store(&pacman->alive, 1);
     pacman->points = points;
     pacman->passo = 0;
     pacman->n_moves = 0;
+    pacman->moves = NULL;
     pacman->current_move = 0;
     pacman->waiting = 0;
+    rng_seed(&pacman->rng, board->opts->seed, entity_stream(board, 0));
+
+    // A level without a PAC file leaves the pacman at (0, 0), played with the keyboard
+    int result = 0;
+    if (board->bundle != NULL && board->opts->pacman_file == NULL) {
+        result = bundle_read_pacman(board);
+    } else if (board->pacman_file[0] != '\0') {
+        result = parse_pacman_file(board);
+    }
+    if (result != 0) return -1;
+    if (!is_valid_position(board, pacman->pos_x, pacman->pos_y)) {
+        debug("Error: Pacman starts at (%d, %d), outside the board\n", pacman->pos_x, pacman->pos_y);
+        return -1;
+    }
 
-    parse_pacman_file(board);
-
-    board_pos_t* start_pos = &board->board[pacman->pos_y * board->width + pacman->pos_x];
-    start_pos->content = 'P';
-    if (start_pos->has_dot) {
-        start_pos->has_dot = 0;
+    int64_t start = cell_index(board, pacman->pos_x, pacman->pos_y);
+    if (ensure_tile(board, start) == NULL) return -1;
+    set_occupant(board, start, OCC_PACMAN | 0);
+    if (test_cell(board, PLANE_DOTS, start)) {
+        clear_cell(board, PLANE_DOTS, start);
         pacman->points++;
     }
     
@@ -481,38 +777,161 @@ int load_ghosts(board_t* board) {
         ghost->pos_y = 0;
         ghost->passo = 0;
         ghost->n_moves = 0;
+        ghost->moves = NULL;
         ghost->current_move = 0;
         ghost->waiting = 0;
         ghost->charged = 0;
+        rng_seed(&ghost->rng, board->opts->seed, entity_stream(board, board->n_pacmans + i));
 
-        parse_ghost_file(board, i);
+        int result = board->bundle != NULL ? bundle_read_ghost(board, i) : parse_ghost_file(board, i);
+        if (result != 0) return -1;
+        if (!is_valid_position(board, ghost->pos_x, ghost->pos_y)) {
+            debug("Error: Ghost %d starts at (%d, %d), outside the board\n", i, ghost->pos_x, ghost->pos_y);
+            return -1;
+        }
 
-        board->board[ghost->pos_y * board->width + ghost->pos_x].content = 'M';
+        int64_t start = cell_index(board, ghost->pos_x, ghost->pos_y);
+        if (ensure_tile(board, start) == NULL) return -1;
+        set_occupant(board, start, OCC_GHOST | i);
     }
     
     return 0;
 }
 
 int load_level(board_t *board, int points) {
-    snprintf(board->level_file, MAX_FILENAME, "%s%d.lvl", board->assets_dir, board->current_level);
-    debug("Loading level file: %s\n", board->level_file);
+    long long start_ns = monotonic_ns();
+    board->load_stats.syscalls = 0;
+    board->load_stats.bytes = 0;
 
-    // Also allocates board, pacmans and ghosts arrays
-    parse_level_file(board);
+    // The arena is reserved by the first level and only reset between levels
+    if (board->arena.base == NULL && arena_init(&board->arena, (size_t)board->opts->arena_mb << 20, board->opts->arena_hugetlb) != 0) {
+        debug("Error: Could not reserve %ld MiB for the level arena\n", board->opts->arena_mb);
+        return -1;
+    }
+
+    // Also allocates board, pacmans and ghosts arrays, in the level arena
+    int result;
+    if (board->bundle != NULL) {
+        debug("Loading level %d from bundle %s\n", board->current_level, board->assets_dir);
+        result = bundle_read_level(board);
+    } else {
+        snprintf(board->level_file, MAX_FILENAME, "%s%d.lvl", board->assets_dir, board->current_level);
+        debug("Loading level file: %s\n", board->level_file);
+        result = parse_level_file(board);
+    }
+
+    if (board->opts->pacman_file != NULL) {
+        snprintf(board->pacman_file, MAX_FILENAME, "%s", board->opts->pacman_file);
+    }
+
+    // The entities may still allocate the tiles they start in, when a level puts them on a wall
+    if (result != 0 || load_pacman(board, points) != 0 || load_ghosts(board) != 0) {
+        debug("Error: Could not load level %d\n", board->current_level);
+        return -1;
+    }
+
+    board->dirty_tiles = arena_alloc(&board->arena, board->n_tiles * sizeof(*board->dirty_tiles));
+    atomic_init(&board->n_dirty, 0);
+    board->full_redraw = 1;
+    int fits = board->dirty_tiles != NULL;
+
+    for (long t = 0; fits && t < board->n_tiles; t++) {
+        tile_t* tile = board->tile_list[t];
+        if (board->opts->engine == ENGINE_POOL && board->opts->locking == LOCKING_RWLOCK) {
+            tile->cell_locks = arena_alloc(&board->arena, TILE_CELLS * sizeof(*tile->cell_locks));
+            fits = tile->cell_locks != NULL;
+            for (int i = 0; fits && i < TILE_CELLS; i++) {
+                pthread_rwlock_init(&tile->cell_locks[i], NULL);
+            }
+        }
+        if (fits && board->opts->contention) {
+            tile->cell_contention = arena_alloc(&board->arena, TILE_CELLS * sizeof(*tile->cell_contention));
+            fits = tile->cell_contention != NULL;
+        }
+    }
 
-    load_pacman(board, points);
-    load_ghosts(board);
+    board->lock_stripes = NULL;
+    if (fits && board->opts->engine == ENGINE_POOL && board->opts->locking == LOCKING_STRIPE) {
+        board->lock_stripes = arena_alloc_aligned(&board->arena, LOCK_STRIPES * sizeof(lock_stripe_t),
+                                                  _Alignof(lock_stripe_t));
+        fits = board->lock_stripes != NULL;
+        for (int i = 0; fits && i < LOCK_STRIPES; i++) {
+            pthread_mutex_init(&board->lock_stripes[i].mutex, NULL);
+        }
+    }
+
+    if (!fits) {
+        debug("Error: Level %d does not fit in the %zu MiB of the level arena\n", board->current_level,
+              board->arena.size >> 20);
+        return -1;
+    }
+
+    board->load_stats.ns = monotonic_ns() - start_ns;
+    debug("Level %d loaded in %.3f ms: %ld syscalls, %ld bytes read, %ld dots\n", board->current_level,
+          board->load_stats.ns / 1e6, board->load_stats.syscalls, board->load_stats.bytes, count_dots(board));
+    debug("Level %d: %ld of %ld tiles allocated, %.1f KiB, %d ghosts\n", board->current_level, board->n_tiles,
+          (long)board->tiles_x * board->tiles_y, (board->n_tiles * sizeof(tile_t)) / 1024.0, board->n_ghosts);
 
     return 0;
 }
 
 void unload_level(board_t * board) {
-    free(board->board);
-    free(board->pacmans);
-    free(board->ghosts);
+    // Everything else is in the arena, only the locks need to be destroyed
+    for (long t = 0; t < board->n_tiles; t++) {
+        tile_t* tile = board->tile_list[t];
+        if (tile->cell_locks != NULL) {
+            for (int i = 0; i < TILE_CELLS; i++) {
+                pthread_rwlock_destroy(&tile->cell_locks[i]);
+            }
+        }
+    }
+    if (board->lock_stripes != NULL) {
+        for (int i = 0; i < LOCK_STRIPES; i++) {
+            pthread_mutex_destroy(&board->lock_stripes[i].mutex);
+        }
+    }
+
+    if (board->arena.base != NULL) {
+        debug("Level %d: %.1f KiB of level arena used, peak %.1f KiB of %zu MiB reserved (%s)\n",
+              board->current_level, board->arena.used / 1024.0, board->arena.peak / 1024.0,
+              board->arena.size >> 20, arena_pages_name(board->arena.pages));
+    }
+    arena_reset(&board->arena);
+    board->tiles = NULL;
+    board->tile_list = NULL;
+    board->dirty_tiles = NULL;
+    board->n_tiles = 0;
+    board->tile_capacity = 0;
+    board->lock_stripes = NULL;
+    board->pacmans = NULL;
+    board->ghosts = NULL;
+    board->ghosts_files = NULL;
+}
+
+// Helper private function for the keys that pick and load quicksave slots or rewind, they are not moves
+static void handle_menu_key(board_t* board) {
+    char key = board->pacmans[0].ui_key;
+    if (key >= '1' && key <= '9') {
+        snapshot_select(key - '1');
+        board->pacmans[0].ui_key = '\0';
+    } else if (key == 'L') {
+        if (board->opts->backup == BACKUP_SNAPSHOT && snapshot_restore(board, snapshot_selected()) == 0) {
+            journal_clear();
+        }
+        board->pacmans[0].ui_key = '\0';
+    } else if (key == 'Z') {
+        journal_rewind(board, JOURNAL_REWIND);
+        board->pacmans[0].ui_key = '\0';
+    }
 }
 
-int create_backup(board_t* board, pthread_t* pacman_tid, pthread_t* ghosts_tid, pacman_thread_arg_t* pacman_args, ghost_thread_arg_t* ghost_args) {
+int create_backup(board_t* board, worker_pool_t* pool) {
+    if (board->opts->backup == BACKUP_SNAPSHOT) {
+        // Nothing is lost when a snapshot cannot be taken, the game just goes on without it
+        snapshot_save(board);
+        return 0;
+    }
+
     if (board->has_saved) {
         debug("State has been already saved.\n");
         return 0;
@@ -520,6 +939,14 @@ int create_backup(board_t* board, pthread_t* pacman_tid, pthread_t* ghosts_tid,
 
     debug("Creating backup process.\n");
 
+    // A loader thread would not survive in the child, let it finish so both processes see its level
+    prefetch_wait();
+    // Buffered replay events would be written by both processes
+    record_flush();
+    // Same for an autosave the writer thread did not finish, it does not survive in the child
+    autosave_wait();
+
+    long long fork_start_ns = monotonic_ns();
     int pid = fork();
     if (pid < 0) {
         debug("Failed to create backup process.\n");
@@ -530,7 +957,7 @@ int create_backup(board_t* board, pthread_t* pacman_tid, pthread_t* ghosts_tid,
     
     if (pid != 0) {
         // Parent process
-        debug("Parent process waiting.\n");
+        debug("Parent process waiting, fork took %.3f ms.\n", (monotonic_ns() - fork_start_ns) / 1e6);
         board->is_backup_instance = 0;
         int status;
         wait(&status); // Wait for child to finish and get its exit status
@@ -542,6 +969,10 @@ int create_backup(board_t* board, pthread_t* pacman_tid, pthread_t* ghosts_tid,
             board->level_result = QUIT_GAME_FORCED;
         }
         debug("Parent process restored from backup.\n");
+        record_resume(board->total_turns);
+        replay_resume();
+        board->full_redraw = 1; // The screen shows the backup instance's game
+
 
         return 0;
     } else {
@@ -550,53 +981,55 @@ int create_backup(board_t* board, pthread_t* pacman_tid, pthread_t* ghosts_tid,
         board->is_backup_instance = 1;
         board->level_result = CONTINUE_PLAY;
 
-        // The semaphores contain values copied from the parent. 
-        // We must reset them to 0 so the new threads start in a blocked state 
-        // waiting for the UI loop to release them.
-        sem_destroy(&sem_start_turn);
-        sem_destroy(&sem_finished_plays);
-        sem_destroy(&sem_render_complete);
-
-        sem_init(&sem_start_turn, 0, 0);
-        sem_init(&sem_finished_plays, 0, 0);
-        sem_init(&sem_render_complete, 0, 0);
-
-        // Recreate threads after fork and Pass the same args as before
-        if (pthread_create(pacman_tid, NULL, pacman_thread, (void*)pacman_args) != 0) {
-            debug("Error recreating pacman thread.\n");
+        // Only this thread survives the fork, the workers must be recreated
+        // with a fresh barrier so they start waiting for the UI loop to release them.
+        if (pool != NULL && pool_restart_after_fork(pool) != 0) {
+            debug("Error recreating worker threads.\n");
             return -1;
         }
+        if (autosave_restart_after_fork() != 0) return -1;
 
-        for (int i = 0; i < board->n_ghosts; i++) {
-            if (pthread_create(&ghosts_tid[i], NULL, ghost_thread, (void*)&ghost_args[i]) != 0) {
-                debug("Error creating ghost thread for ghost %d.\n", i);
-                return -1;
-            }
-        }
-
-        // Indicate we are in backup instance, so it needs to skip sem post of ui 
-        // because of sync issues with newly created threads, basically force restart of the loop
+        // Indicate we are in backup instance, so it needs to skip the render of this turn
+        // because the workers were just recreated, basically force restart of the loop
         return 1; 
     }
 }
 
 
-// Helper private function to find and kill pacman at specific position
-static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
-    for (int p = 0; p < board->n_pacmans; p++) {
-        pacman_t* pac = &board->pacmans[p];
-        if (pac->pos_x == new_x && pac->pos_y == new_y && pac->alive) {
-            pac->alive = 0;
-            kill_pacman(board, p);
-            return DEAD_PACMAN;
-        }
+// Helper private function to kill the pacman a ghost just ran into
+static int kill_pacman_if_alive(board_t* board, int pacman_id) {
+    if (!atomic_load(&board->pacmans[pacman_id].alive)) return CONTINUE;
+    kill_pacman(board, pacman_id);
+    return DEAD_PACMAN;
+}
+
+// Helpers private functions for the occupancy outside of the lock-free moves, the cells are locked or
+// only one thread plays, so the atomics are only there for the CAS moves
+static inline uint32_t get_occupant(board_t* board, int64_t index) {
+    return atomic_load_explicit(cell_occupancy(board, index), memory_order_relaxed);
+}
+
+static inline void set_occupant(board_t* board, int64_t index, uint32_t occupant) {
+    atomic_store_explicit(cell_occupancy(board, index), occupant, memory_order_relaxed);
+}
+
+// Helper private function for the priority of a play result, the most important one of a turn wins
+static inline int play_result_priority(int result) {
+    switch (result) {
+        case QUIT_PRESSED:   return 4;
+        case DEAD_PACMAN:    return 3;
+        case REACHED_PORTAL: return 2;
+        case CREATE_BACKUP:  return 1;
+        default:             return 0;
     }
-    return CONTINUE;
 }
 
-// Helper private function for getting board position index
-static inline int get_board_index(board_t* board, int x, int y) {
-    return y * board->width + x;
+// Helper private function for reporting the result of a play, keeps it if a more important one was reported
+static inline void merge_play_result(board_t* board, int result) {
+    int current = atomic_load_explicit(&board->play_result, memory_order_relaxed);
+    while (play_result_priority(result) > play_result_priority(current) &&
+           !atomic_compare_exchange_weak_explicit(&board->play_result, &current, result,
+                                                  memory_order_relaxed, memory_order_relaxed));
 }
 
 // Helper private function for checking valid position
@@ -604,37 +1037,101 @@ static inline int is_valid_position(board_t* board, int x, int y) {
     return (x >= 0 && x < board->width) && (y >= 0 && y < board->height); // Inside of the board boundaries
 }
 
-static inline void finish_play(board_t *board, int *level_state) {
-    // 1. Tell UI we are done with our move
-    sem_post(&sem_finished_plays);
+// Helper private function for the rwlock of a cell, in its tile
+static inline pthread_rwlock_t* cell_lock(board_t* board, int64_t index) {
+    return &cell_tile(board, index)->cell_locks[index & (TILE_CELLS - 1)];
+}
+
+// Helper private function for the stripe guarding a cell, neighbouring cells land on different stripes
+static inline int lock_stripe(int64_t index) {
+    return (int)(((uint64_t)index * 0x9e3779b97f4a7c15ull) >> 56) & (LOCK_STRIPES - 1);
+}
 
-    // 2. Wait for UI to finish rendering and game state checks
-    // This acts as a barrier so we don't loop around too fast
-    sem_wait(&sem_render_complete);
+// Helper private function for counting a failed attempt at taking cell 'index'
+static inline void count_contention(board_t* board, lock_stats_t* stats, int64_t index, int first_try,
+                                    long long waited_ns) {
+    if (first_try) stats->contended++;
+    stats->retries++;
+    stats->waited_ns += waited_ns;
+    atomic_fetch_add_explicit(&cell_tile(board, index)->cell_contention[index & (TILE_CELLS - 1)], 1,
+                              memory_order_relaxed);
+}
 
-    // 3. Update local state (safe now because UI has finished writing to it)
-    *level_state = board->level_result;
+// Helper private function for taking a stripe, timing the wait when it is contended and counted
+static inline void lock_stripe_counted(board_t* board, lock_stats_t* stats, int stripe, int64_t index,
+                                       int* first_try) {
+    pthread_mutex_t* mutex = &board->lock_stripes[stripe].mutex;
+    if (!board->opts->contention) {
+        pthread_mutex_lock(mutex);
+    } else if (pthread_mutex_trylock(mutex) != 0) {
+        long long start_ns = monotonic_ns();
+        pthread_mutex_lock(mutex);
+        count_contention(board, stats, index, *first_try, monotonic_ns() - start_ns);
+        *first_try = 0;
+    }
 }
 
-static inline void lock_for_move(board_t* board, int old_index, int new_index) {
+// The serial engine plays every entity on one thread, so it has no cell locks and skips the locking below
+static inline void lock_for_move(board_t* board, rng_t* rng, lock_stats_t* stats, int64_t old_index,
+                                 int64_t new_index) {
+    int counting = board->opts->contention;
+    int first_try = 1;
+
+    if (board->lock_stripes != NULL) {
+        if (counting) stats->moves++;
+
+        // Stripes are always taken lowest first, so two moves can never wait for each other in a cycle
+        int first = lock_stripe(old_index);
+        int second = lock_stripe(new_index);
+        int64_t first_cell = old_index, second_cell = new_index;
+        if (first > second) {
+            first = second;
+            first_cell = new_index;
+            second = lock_stripe(old_index);
+            second_cell = old_index;
+        }
+        lock_stripe_counted(board, stats, first, first_cell, &first_try);
+        if (second != first) lock_stripe_counted(board, stats, second, second_cell, &first_try);
+        return;
+    }
+    if (cell_tile(board, old_index)->cell_locks == NULL) return;
+    if (counting) stats->moves++;
+
+    pthread_rwlock_t* old_lock = cell_lock(board, old_index);
+    pthread_rwlock_t* new_lock = cell_lock(board, new_index);
+
     int locks_acquired = 0;
     int n_tries = 1;
-    int backoff_range = (int)(0.05 * board->tempo);
+    int backoff_range = board->tempo_us / 20000; // 5% of the tempo, in ms
     if (backoff_range < 1) backoff_range = 1;
 
     while (!locks_acquired) {
-        pthread_rwlock_wrlock(&board->board[old_index].rwlock);
-        if (pthread_rwlock_trywrlock(&board->board[new_index].rwlock) == 0) {
+        pthread_rwlock_wrlock(old_lock);
+        if (pthread_rwlock_trywrlock(new_lock) == 0) {
             locks_acquired = 1;
         } else {
-            pthread_rwlock_unlock(&board->board[old_index].rwlock);
-            sleep_ms(rand() % (n_tries * backoff_range));
+            pthread_rwlock_unlock(old_lock);
+            long long start_ns = counting ? monotonic_ns() : 0;
+            sleep_ms(rng_below(rng, n_tries * backoff_range));
+            if (counting) {
+                count_contention(board, stats, new_index, first_try, monotonic_ns() - start_ns);
+                first_try = 0;
+            }
             n_tries++;
         }
     }
 }
 
-static inline void unlock_after_move(board_t* board, int old_index, int new_index) {
-    pthread_rwlock_unlock(&board->board[old_index].rwlock);
-    pthread_rwlock_unlock(&board->board[new_index].rwlock);
+static inline void unlock_after_move(board_t* board, int64_t old_index, int64_t new_index) {
+    if (board->lock_stripes != NULL) {
+        int first = lock_stripe(old_index);
+        int second = lock_stripe(new_index);
+        pthread_mutex_unlock(&board->lock_stripes[first].mutex);
+        if (second != first) pthread_mutex_unlock(&board->lock_stripes[second].mutex);
+        return;
+    }
+    if (cell_tile(board, old_index)->cell_locks == NULL) return;
+
+    pthread_rwlock_unlock(cell_lock(board, old_index));
+    pthread_rwlock_unlock(cell_lock(board, new_index));
 }
@@ -0,0 +1,379 @@
+#include "bundle.h"
+#include "board.h"
+#include "parser.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// Growable output buffer used while compiling a bundle
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} out_buffer_t;
+
+static int check_level(const bundle_t* bundle, const bundle_index_t* entry);
+static int in_extent(uint64_t start, uint64_t end, uint64_t offset, uint64_t count, size_t item, size_t align);
+static const bundle_level_t* get_level(const bundle_t* bundle, int level);
+static const bundle_script_t* get_script(const bundle_t* bundle, const bundle_level_t* lvl, int script);
+static int read_script(board_t* board, const bundle_script_t* script, int* pos_x, int* pos_y, int* passo,
+                       command_t** moves, int* n_moves);
+static size_t out_reserve(out_buffer_t* out, size_t size);
+static int compile_level(board_t* board, out_buffer_t* out, int level);
+static void compile_script(out_buffer_t* out, size_t script_offset, const char* file, int pos_x, int pos_y,
+                           int passo, const command_t* moves, int n_moves);
+
+
+int is_bundle_path(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+int bundle_open(bundle_t* bundle, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error: Could not open bundle");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(bundle_header_t)) {
+        fprintf(stderr, "Error: %s is not a level bundle\n", path);
+        close(fd);
+        return -1;
+    }
+
+    bundle->size = st.st_size;
+    bundle->data = mmap(NULL, bundle->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bundle->data == MAP_FAILED) {
+        perror("Error: Could not map bundle");
+        return -1;
+    }
+
+    bundle->header = (const bundle_header_t*)bundle->data;
+    const bundle_header_t* header = bundle->header;
+    if (memcmp(header->magic, BUNDLE_MAGIC, sizeof(header->magic)) != 0 || header->version != BUNDLE_VERSION ||
+        !in_extent(0, bundle->size, header->index_offset, header->n_levels, sizeof(bundle_index_t), 8)) {
+        fprintf(stderr, "Error: %s is not a level bundle of version %d\n", path, BUNDLE_VERSION);
+        bundle_close(bundle);
+        return -1;
+    }
+
+    bundle->index = (const bundle_index_t*)(bundle->data + header->index_offset);
+    // Every offset and count of a level is checked once here, the loads then trust them
+    for (uint32_t i = 0; i < header->n_levels; i++) {
+        if (check_level(bundle, &bundle->index[i]) != 0) {
+            fprintf(stderr, "Error: level %u of %s is truncated or corrupt\n", i + 1, path);
+            bundle_close(bundle);
+            return -1;
+        }
+    }
+
+    debug("Opened bundle %s: %u levels, %zu bytes\n", path, header->n_levels, bundle->size);
+    return 0;
+}
+
+void bundle_close(bundle_t* bundle) {
+    munmap((void*)bundle->data, bundle->size);
+    bundle->data = NULL;
+}
+
+int bundle_read_level(board_t* board) {
+    const bundle_t* bundle = board->bundle;
+    const bundle_level_t* lvl = get_level(bundle, board->current_level);
+    if (lvl == NULL) {
+        debug("Level %d is not in the bundle\n", board->current_level);
+        return -1;
+    }
+
+    snprintf(board->level_file, MAX_FILENAME, "%s:%s", board->assets_dir, lvl->name);
+    board->width = lvl->width;
+    board->height = lvl->height;
+    board->tempo_us = lvl->tempo_us;
+    board->n_pacmans = 1;
+    board->n_ghosts = lvl->n_ghosts;
+
+    board->pacmans = arena_alloc(&board->arena, board->n_pacmans * sizeof(pacman_t));
+    board->ghosts = NULL;
+    board->ghosts_files = NULL;
+    if (board->n_ghosts > 0) {
+        board->ghosts = arena_alloc(&board->arena, board->n_ghosts * sizeof(ghost_t));
+        board->ghosts_files = arena_alloc(&board->arena, board->n_ghosts * sizeof(char*));
+    }
+    if (board->pacmans == NULL || (board->n_ghosts > 0 && (board->ghosts == NULL || board->ghosts_files == NULL)) ||
+        alloc_tiles(board) != 0) {
+        debug("Error: Could not allocate board of level %d\n", board->current_level);
+        return -1;
+    }
+
+    snprintf(board->pacman_file, MAX_FILENAME, "%s", get_script(bundle, lvl, 0)->name);
+    for (int i = 0; i < board->n_ghosts; i++) {
+        const char* name = get_script(bundle, lvl, 1 + i)->name;
+        board->ghosts_files[i] = arena_strndup(&board->arena, name, strnlen(name, BUNDLE_NAME_LEN));
+        if (board->ghosts_files[i] == NULL) {
+            debug("Error: Could not allocate board of level %d\n", board->current_level);
+            return -1;
+        }
+    }
+
+    // The cells are laid out row-major, one flags byte each, the cells the map rows did not reach were
+    // compiled as walls. Tiles start as walls, only the other cells allocate one.
+    const uint8_t* cells = bundle->data + lvl->cells_offset;
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            uint8_t flags = *cells++;
+            if (flags & BUNDLE_CELL_WALL) continue;
+            int64_t index = cell_index(board, x, y);
+            if (ensure_tile(board, index) == NULL) {
+                debug("Error: Could not allocate board of level %d\n", board->current_level);
+                return -1;
+            }
+            clear_cell(board, PLANE_WALLS, index);
+            if (flags & BUNDLE_CELL_DOT) set_cell(board, PLANE_DOTS, index);
+            if (flags & BUNDLE_CELL_PORTAL) set_cell(board, PLANE_PORTALS, index);
+        }
+    }
+
+    board->load_stats.bytes += bundle->index[board->current_level - 1].size;
+    return 0;
+}
+
+int bundle_read_pacman(board_t* board) {
+    const bundle_level_t* lvl = get_level(board->bundle, board->current_level);
+    const bundle_script_t* script = get_script(board->bundle, lvl, 0);
+    if (script->name[0] == '\0') return 0; // Level without PAC file, the pacman stays with the keyboard
+
+    pacman_t* pacman = &board->pacmans[0];
+    return read_script(board, script, &pacman->pos_x, &pacman->pos_y, &pacman->passo, &pacman->moves,
+                       &pacman->n_moves);
+}
+
+int bundle_read_ghost(board_t* board, int ghost_idx) {
+    const bundle_level_t* lvl = get_level(board->bundle, board->current_level);
+    const bundle_script_t* script = get_script(board->bundle, lvl, 1 + ghost_idx);
+
+    ghost_t* ghost = &board->ghosts[ghost_idx];
+    return read_script(board, script, &ghost->pos_x, &ghost->pos_y, &ghost->passo, &ghost->moves,
+                       &ghost->n_moves);
+}
+
+int bundle_compile(const char* levels_dir, const char* out_path) {
+    board_t board;
+    memset(&board, 0, sizeof(board));
+    snprintf(board.assets_dir, MAX_DIRNAME, "%s", levels_dir);
+
+    if (parse_levels_directory(&board) != 0) return -1;
+    if (arena_init(&board.arena, (size_t)ARENA_RESERVE_MB << 20, 0) != 0) {
+        perror("Error: Could not reserve the level arena");
+        return -1;
+    }
+
+    out_buffer_t out = {0};
+    size_t header_offset = out_reserve(&out, sizeof(bundle_header_t));
+    size_t index_offset = out_reserve(&out, board.n_levels * sizeof(bundle_index_t));
+
+    for (int level = 1; level <= board.n_levels; level++) {
+        // The level starts at the next aligned offset, where compile_level reserves its bundle_level_t
+        size_t level_offset = out_reserve(&out, 0);
+        if (compile_level(&board, &out, level) != 0) {
+            fprintf(stderr, "Error: Could not compile level %d of %s\n", level, levels_dir);
+            free(out.data);
+            arena_destroy(&board.arena);
+            return -1;
+        }
+        bundle_index_t* entry = (bundle_index_t*)(out.data + index_offset) + (level - 1);
+        entry->offset = level_offset;
+        entry->size = out.size - level_offset;
+    }
+
+    bundle_header_t* header = (bundle_header_t*)(out.data + header_offset);
+    memcpy(header->magic, BUNDLE_MAGIC, sizeof(header->magic));
+    header->version = BUNDLE_VERSION;
+    header->n_levels = board.n_levels;
+    header->index_offset = index_offset;
+    arena_destroy(&board.arena);
+
+    FILE* file = fopen(out_path, "wb");
+    if (file == NULL) {
+        perror("Error: Could not create bundle");
+        free(out.data);
+        return -1;
+    }
+    int ok = fwrite(out.data, 1, out.size, file) == out.size;
+    ok = (fclose(file) == 0) && ok;
+    free(out.data);
+
+    if (!ok) {
+        perror("Error: Could not write bundle");
+        return -1;
+    }
+    debug("Compiled %d levels from %s into %s\n", board.n_levels, levels_dir, out_path);
+    return 0;
+}
+
+// Helper private function checking that 'count' items of 'item' bytes at 'offset' lie in [start, end) and
+// that 'offset' is a multiple of 'align'
+static int in_extent(uint64_t start, uint64_t end, uint64_t offset, uint64_t count, size_t item, size_t align) {
+    if (offset < start || offset > end || offset % align != 0) return 0;
+    return count <= (end - offset) / item;
+}
+
+// Helper private function checking that the level of 'entry', its scripts, their moves and its cells all lie
+// within the level's extent of the file, and that its names, sizes and positions make sense.
+// Returns 0 if the level can be loaded, -1 otherwise.
+static int check_level(const bundle_t* bundle, const bundle_index_t* entry) {
+    if (!in_extent(0, bundle->size, entry->offset, entry->size, 1, 8)) return -1;
+    uint64_t start = entry->offset;
+    uint64_t end = entry->offset + entry->size;
+
+    if (!in_extent(start, end, start, 1, sizeof(bundle_level_t), 8)) return -1;
+    const bundle_level_t* lvl = (const bundle_level_t*)(bundle->data + start);
+    if (memchr(lvl->name, '\0', BUNDLE_NAME_LEN) == NULL || lvl->width <= 0 || lvl->height <= 0 ||
+        lvl->n_ghosts < 0 || lvl->tempo_us < 0) {
+        return -1;
+    }
+    if (!in_extent(start, end, lvl->cells_offset, (uint64_t)lvl->width * (uint64_t)lvl->height, 1, 1) ||
+        !in_extent(start, end, lvl->scripts_offset, 1 + (uint64_t)lvl->n_ghosts, sizeof(bundle_script_t), 8)) {
+        return -1;
+    }
+
+    const bundle_script_t* scripts = (const bundle_script_t*)(bundle->data + lvl->scripts_offset);
+    for (int32_t i = 0; i <= lvl->n_ghosts; i++) {
+        const bundle_script_t* script = &scripts[i];
+        if (memchr(script->name, '\0', BUNDLE_NAME_LEN) == NULL || script->n_moves < 0 ||
+            script->pos_x < 0 || script->pos_x >= lvl->width || script->pos_y < 0 || script->pos_y >= lvl->height) {
+            return -1;
+        }
+        if (script->n_moves > 0 &&
+            !in_extent(start, end, script->moves_offset, script->n_moves, sizeof(bundle_command_t), 4)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Helper private function returning level 'level' (1-based) of the bundle, NULL if there is no such level
+static const bundle_level_t* get_level(const bundle_t* bundle, int level) {
+    if (level < 1 || (uint32_t)level > bundle->header->n_levels) return NULL;
+    return (const bundle_level_t*)(bundle->data + bundle->index[level - 1].offset);
+}
+
+static const bundle_script_t* get_script(const bundle_t* bundle, const bundle_level_t* lvl, int script) {
+    return (const bundle_script_t*)(bundle->data + lvl->scripts_offset) + script;
+}
+
+// Helper private function filling an entity from 'script', its moves go into the level arena
+static int read_script(board_t* board, const bundle_script_t* script, int* pos_x, int* pos_y, int* passo,
+                       command_t** moves, int* n_moves) {
+    const bundle_command_t* commands = (const bundle_command_t*)(board->bundle->data + script->moves_offset);
+
+    *pos_x = script->pos_x;
+    *pos_y = script->pos_y;
+    *passo = script->passo;
+    *moves = script->n_moves > 0 ? arena_alloc(&board->arena, script->n_moves * sizeof(command_t)) : NULL;
+    if (script->n_moves > 0 && *moves == NULL) {
+        debug("Error: Could not allocate the %d moves of %.*s\n", script->n_moves, BUNDLE_NAME_LEN, script->name);
+        *n_moves = 0;
+        return -1;
+    }
+    *n_moves = script->n_moves;
+    for (int i = 0; i < *n_moves; i++) {
+        (*moves)[i].command = commands[i].command;
+        (*moves)[i].turns = commands[i].turns;
+        (*moves)[i].turns_left = commands[i].turns;
+    }
+    return 0;
+}
+
+// Appends 'size' zeroed bytes at an 8-byte aligned offset, returns that offset
+static size_t out_reserve(out_buffer_t* out, size_t size) {
+    size_t offset = (out->size + 7) & ~(size_t)7;
+    if (offset + size > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 4096;
+        while (capacity < offset + size) capacity *= 2;
+        out->data = realloc(out->data, capacity);
+        if (out->data == NULL) {
+            perror("Error: Out of memory compiling bundle");
+            exit(1);
+        }
+        out->capacity = capacity;
+    }
+    memset(out->data + out->size, 0, offset + size - out->size);
+    out->size = offset + size;
+    return offset;
+}
+
+static int compile_level(board_t* board, out_buffer_t* out, int level) {
+    board->current_level = level;
+    snprintf(board->level_file, MAX_FILENAME, "%s%d.lvl", board->assets_dir, level);
+    if (parse_level_file(board) != 0) return -1;
+
+    if (board->pacman_file[0] != '\0' && parse_pacman_file(board) != 0) return -1;
+    for (int i = 0; i < board->n_ghosts; i++) {
+        if (parse_ghost_file(board, i) != 0) return -1;
+    }
+
+    size_t level_offset = out_reserve(out, sizeof(bundle_level_t));
+    size_t scripts_offset = out_reserve(out, (1 + board->n_ghosts) * sizeof(bundle_script_t));
+
+    bundle_level_t* lvl = (bundle_level_t*)(out->data + level_offset);
+    snprintf(lvl->name, BUNDLE_NAME_LEN, "%d.lvl", level);
+    lvl->width = board->width;
+    lvl->height = board->height;
+    lvl->tempo_us = board->tempo_us;
+    lvl->n_ghosts = board->n_ghosts;
+    lvl->scripts_offset = scripts_offset;
+
+    pacman_t* pacman = &board->pacmans[0];
+    const char* pacman_name = board->pacman_file[0] != '\0' ? board->pacman_file + strlen(board->assets_dir) : "";
+    compile_script(out, scripts_offset, pacman_name, pacman->pos_x, pacman->pos_y,
+                   pacman->passo, pacman->moves, pacman->n_moves);
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        compile_script(out, scripts_offset + (1 + i) * sizeof(bundle_script_t),
+                       board->ghosts_files[i] + strlen(board->assets_dir), ghost->pos_x, ghost->pos_y,
+                       ghost->passo, ghost->moves, ghost->n_moves);
+    }
+
+    size_t n_cells = (size_t)board->width * board->height;
+    size_t cells_offset = out_reserve(out, n_cells);
+    ((bundle_level_t*)(out->data + level_offset))->cells_offset = cells_offset;
+
+    uint8_t* cells = out->data + cells_offset;
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            int64_t index = cell_index(board, x, y);
+            *cells++ = (test_cell(board, PLANE_WALLS, index) ? BUNDLE_CELL_WALL : 0) |
+                       (test_cell(board, PLANE_DOTS, index) ? BUNDLE_CELL_DOT : 0) |
+                       (test_cell(board, PLANE_PORTALS, index) ? BUNDLE_CELL_PORTAL : 0);
+        }
+    }
+
+    unload_level(board);
+    return 0;
+}
+
+static void compile_script(out_buffer_t* out, size_t script_offset, const char* file, int pos_x, int pos_y,
+                           int passo, const command_t* moves, int n_moves) {
+    size_t moves_offset = out_reserve(out, n_moves * sizeof(bundle_command_t));
+    bundle_command_t* commands = (bundle_command_t*)(out->data + moves_offset);
+    for (int i = 0; i < n_moves; i++) {
+        commands[i].command = moves[i].command;
+        commands[i].turns = moves[i].turns;
+    }
+
+    bundle_script_t* script = (bundle_script_t*)(out->data + script_offset);
+    snprintf(script->name, BUNDLE_NAME_LEN, "%s", file);
+    script->pos_x = pos_x;
+    script->pos_y = pos_y;
+    script->passo = passo;
+    script->n_moves = n_moves;
+    script->moves_offset = moves_offset;
+}
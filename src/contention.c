@@ -0,0 +1,136 @@
+#include "contention.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static void add_stats(lock_stats_t* total, const lock_stats_t* stats);
+static void report_entity(const char* kind, int id, const lock_stats_t* stats, const char* note);
+static void report_hottest_cells(const board_t* board);
+static void report_heatmap(const board_t* board);
+
+
+void contention_report(const board_t* board) {
+    lock_stats_t total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < board->n_pacmans; i++) add_stats(&total, &board->pacmans[i].lock_stats);
+    for (int i = 0; i < board->n_ghosts; i++) add_stats(&total, &board->ghosts[i].lock_stats);
+
+    debug("=== LOCK CONTENTION level %d ===\n", board->current_level);
+    debug("Total: %ld moves, %ld contended (%.2f%%), %ld retries, %.3f ms waited\n", total.moves, total.contended,
+          total.moves > 0 ? 100.0 * total.contended / total.moves : 0.0, total.retries, total.waited_ns / 1e6);
+
+    for (int i = 0; i < board->n_pacmans; i++) {
+        report_entity("Pacman", i, &board->pacmans[i].lock_stats, "");
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        // Charged ghosts take the locks once per step of their run
+        int charges = 0;
+        for (int m = 0; m < board->ghosts[i].n_moves; m++) {
+            if (board->ghosts[i].moves[m].command == 'C') charges++;
+        }
+        report_entity("Ghost", i, &board->ghosts[i].lock_stats, charges > 0 ? " (charges)" : "");
+    }
+
+    report_hottest_cells(board);
+    report_heatmap(board);
+}
+
+static void add_stats(lock_stats_t* total, const lock_stats_t* stats) {
+    total->moves += stats->moves;
+    total->contended += stats->contended;
+    total->retries += stats->retries;
+    total->waited_ns += stats->waited_ns;
+}
+
+static void report_entity(const char* kind, int id, const lock_stats_t* stats, const char* note) {
+    debug("  %s %d%s: %ld moves, %ld contended, %ld retries, %.3f ms waited\n", kind, id, note,
+          stats->moves, stats->contended, stats->retries, stats->waited_ns / 1e6);
+}
+
+// Contention of cell 'index', which is in an allocated tile
+static long cell_count(const board_t* board, int64_t index) {
+    return atomic_load_explicit(&cell_tile(board, index)->cell_contention[index & (TILE_CELLS - 1)],
+                                memory_order_relaxed);
+}
+
+static void report_hottest_cells(const board_t* board) {
+    int64_t top[CONTENTION_TOP_CELLS];
+    int n_top = 0;
+
+    // Keeps the hottest cells sorted, the tiles are only scanned once and the missing ones are all walls
+    for (long t = 0; t < board->n_tiles; t++) {
+        const tile_t* tile = board->tile_list[t];
+        int64_t first = ((int64_t)tile->tile_y * board->tiles_x + tile->tile_x) << (2 * TILE_SHIFT);
+        for (int i = 0; i < TILE_CELLS; i++) {
+            long count = atomic_load_explicit(&tile->cell_contention[i], memory_order_relaxed);
+            if (count == 0) continue;
+            if (n_top == CONTENTION_TOP_CELLS && count <= cell_count(board, top[n_top - 1])) continue;
+
+            int pos = n_top < CONTENTION_TOP_CELLS ? n_top++ : n_top - 1;
+            while (pos > 0 && cell_count(board, top[pos - 1]) < count) {
+                top[pos] = top[pos - 1];
+                pos--;
+            }
+            top[pos] = first + i;
+        }
+    }
+
+    debug("Hottest cells:%s\n", n_top == 0 ? " none" : "");
+    for (int i = 0; i < n_top; i++) {
+        debug("  row %d, column %d: %ld\n", cell_y(board, top[i]), cell_x(board, top[i]), cell_count(board, top[i]));
+    }
+}
+
+static void report_heatmap(const board_t* board) {
+    static const char scale[] = " .:-=+*#%@";
+    int block_w = (board->width + HEATMAP_MAX_COLS - 1) / HEATMAP_MAX_COLS;
+    int block_h = (board->height + HEATMAP_MAX_ROWS - 1) / HEATMAP_MAX_ROWS;
+    int block = block_w > block_h ? block_w : block_h;
+    int cols = (board->width + block - 1) / block;
+    int rows = (board->height + block - 1) / block;
+
+    long* heat = calloc((size_t)cols * rows, sizeof(long));
+    if (heat == NULL) return;
+
+    long max_heat = 0;
+    for (long t = 0; t < board->n_tiles; t++) {
+        const tile_t* tile = board->tile_list[t];
+        for (int i = 0; i < TILE_CELLS; i++) {
+            long count = atomic_load_explicit(&tile->cell_contention[i], memory_order_relaxed);
+            if (count == 0) continue;
+            int x = tile->tile_x * TILE_SIZE + (i & TILE_MASK);
+            int y = tile->tile_y * TILE_SIZE + (i >> TILE_SHIFT);
+            long* cell = &heat[(y / block) * cols + x / block];
+            *cell += count;
+            if (*cell > max_heat) max_heat = *cell;
+        }
+    }
+
+    if (max_heat == 0) {
+        debug("Heatmap: no contention\n");
+        free(heat);
+        return;
+    }
+
+    debug("Heatmap (%dx%d cells per character%s):\n", block, block, block == 1 ? ", walls are 'W'" : "");
+    char line[HEATMAP_MAX_COLS + 2];
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            long value = heat[r * cols + c];
+            if (value == 0 && block == 1 && test_cell(board, PLANE_WALLS, cell_index(board, c, r))) {
+                line[c] = 'W';
+            } else if (value == 0) {
+                line[c] = scale[0];
+            } else {
+                // Any contention shows up, the hottest block gets the last character
+                line[c] = scale[1 + value * (long)(sizeof(scale) - 3) / max_heat];
+            }
+        }
+        line[cols] = '\n';
+        line[cols + 1] = '\0';
+        debug("%s", line);
+    }
+
+    free(heat);
+}
@@ -1,6 +1,8 @@
 #include "display.h"
+#include "snapshot.h"
 #include "board.h"
 #include "utils.h"
+#include "kernels.h"
 #include <stdlib.h>
 #include <ctype.h>
 
@@ -45,9 +47,38 @@ int terminal_init() {
 }
 
 
+// Starting row for the game board (leave space for UI)
+#define BOARD_START_ROW 3
+// The viewport recentres on pacman when it comes closer than 1/VIEW_MARGIN of the view to an edge
+#define VIEW_MARGIN 4
+
+static int follow_pacman(board_t* board);
+static int follow(int pos, int start, int size, int limit);
+static int draw_cell(board_t* board, int64_t index);
+static void draw_row(board_t* board, int y);
+static chtype cell_look(board_t* board, uint32_t occupant, char glyph);
+
+static const char map_glyphs[4] = {' ', '#', '@', '.'};    // empty, wall, portal and dot
+static chtype* row_looks = NULL;    // the tiles of the row being drawn, one look per cell
+static int row_capacity = 0;
+
+static int view_x = 0, view_y = 0;  // part of the board on screen, the board is bigger than the terminal
+static int view_w = 0, view_h = 0;
+static int drawn_lines = 0, drawn_cols = 0;   // terminal size of the last frame, to detect resizes
+static long frames_drawn = 0;
+static long cells_drawn = 0;
+
+
 void draw_board(board_t* board, int mode) {
-    // Clear the screen before redrawing
-    clear();
+    int moved = follow_pacman(board);
+    int full = board->full_redraw || moved || LINES != drawn_lines || COLS != drawn_cols;
+
+    if (full) {
+        // Clear the screen before redrawing
+        clear();
+        drawn_lines = LINES;
+        drawn_cols = COLS;
+    }
 
     // Draw the border/title
     attron(COLOR_PAIR(5));
@@ -63,81 +94,156 @@ void draw_board(board_t* board, int mode) {
 
     case DRAW_MENU:
         mvprintw(1, 0, "Level: %s | Use W/A/S/D to move | Q to quit | G to quicksave ", board->level_file);
+        if (board->opts->backup == BACKUP_SNAPSHOT) printw("| L to load | 1-9 slot ");
+        if (board->opts->journal_kb > 0) printw("| Z to rewind ");
         break;
     }
+    clrtoeol();
 
+    int n_dirty = atomic_load(&board->n_dirty);
+    long drawn = 0;
 
-    // Starting row for the game board (leave space for UI)
-    int start_row = 3;
-
-    // Draw the board
-    for (int y = 0; y < board->height; y++) {
-        for (int x = 0; x < board->width; x++) {
-            int index = y * board->width + x;
-            char ch = board->board[index].content;
-            int ghost_charged = 0;
-
-            for (int g = 0; g < board->n_ghosts; g++) {
-                ghost_t* ghost = &board->ghosts[g];
-                if (ghost->pos_x == x && ghost->pos_y == y) {
-                    if (ghost->charged)
-                        ghost_charged = 1;
-                    break;
-                }
-            }
-
-            // Move cursor to position
-            move(start_row + y, x);
-
-            // Draw with appropriate color
-            switch (ch) {
-                case 'W': // Wall
-                    attron(COLOR_PAIR(3));
-                    addch('#');
-                    attroff(COLOR_PAIR(3));
-                    break;
-
-                case 'P': // Pacman
-                    attron(COLOR_PAIR(1) | A_BOLD);
-                    addch('C');
-                    attroff(COLOR_PAIR(1) | A_BOLD);
-                    break;
-
-                case 'M': // Monster/Ghost
-                    attron((COLOR_PAIR(2) | A_BOLD) | ((ghost_charged) ? (A_DIM) : (0)));
-                    addch('M');
-                    attroff((COLOR_PAIR(2) | A_BOLD) | ((ghost_charged) ? (A_DIM) : (0)));
-                    break;
-
-                case ' ': // Empty space
-                    if (board->board[index].has_portal) {
-                        attron(COLOR_PAIR(6));
-                        addch('@');
-                        attroff(COLOR_PAIR(6));
-                    }
-                    else if (board->board[index].has_dot) {
-                        attron(COLOR_PAIR(4));
-                        addch('.');
-                        attroff(COLOR_PAIR(4));
-                    }
-                    else
-                        addch(' ');
-                    break;
-
-                default:
-                    addch(ch);
-                    break;
+    if (full) {
+        drawn = (long)view_w * view_h;
+        for (int y = view_y; y < view_y + view_h; y++) {
+            draw_row(board, y);
+        }
+    }
+    // The cells changed since the last frame, only the ones in the viewport are drawn
+    for (int i = 0; i < n_dirty; i++) {
+        tile_t* tile = board->dirty_tiles[i];
+        atomic_store_explicit(&tile->queued, 0, memory_order_relaxed);
+        int64_t first = ((int64_t)tile->tile_y * board->tiles_x + tile->tile_x) << (2 * TILE_SHIFT);
+        for (int row = 0; row < TILE_SIZE; row++) {
+            uint64_t cells = atomic_exchange_explicit(&tile->dirty[row], 0, memory_order_relaxed);
+            while (cells != 0 && !full) {
+                drawn += draw_cell(board, first + row * TILE_SIZE + __builtin_ctzll(cells));
+                cells &= cells - 1;
             }
         }
     }
+    atomic_store(&board->n_dirty, 0);
+    board->full_redraw = 0;
+
+    frames_drawn++;
+    cells_drawn += drawn;
+    debug_hot("FRAME: %ld cells drawn%s\n", drawn, full ? " (full redraw)" : "");
 
     // Draw score/status at the bottom
     attron(COLOR_PAIR(5));
-    mvprintw(start_row + board->height + 1, 0, "Points: %d",
+    mvprintw(BOARD_START_ROW + view_h + 1, 0, "Points: %d",
              board->pacmans[0].points); // Assuming first pacman for now
+    if (board->opts->backup == BACKUP_SNAPSHOT) printw(" | Slot: %d", snapshot_selected() + 1);
+    clrtoeol();
     attroff(COLOR_PAIR(5));
 }
 
+// Helper private function sizing the viewport to the terminal and keeping pacman inside it.
+// Returns whether it moved or changed size, the whole view must be redrawn then.
+static int follow_pacman(board_t* board) {
+    int w = COLS < board->width ? COLS : board->width;
+    int h = LINES - BOARD_START_ROW - 2 < board->height ? LINES - BOARD_START_ROW - 2 : board->height;
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+
+    const pacman_t* pacman = &board->pacmans[0];
+    int x = follow(pacman->pos_x, view_x, w, board->width);
+    int y = follow(pacman->pos_y, view_y, h, board->height);
+    int moved = x != view_x || y != view_y || w != view_w || h != view_h;
+    view_x = x;
+    view_y = y;
+    view_w = w;
+    view_h = h;
+    return moved;
+}
+
+// Helper private function for the start of a view of 'size' cells along an axis of 'limit' cells, it only
+// recentres on 'pos' when that gets too close to an edge, so the screen does not scroll on every move
+static int follow(int pos, int start, int size, int limit) {
+    int margin = size / VIEW_MARGIN;
+    if (pos < start + margin || pos >= start + size - margin) start = pos - size / 2;
+    if (start > limit - size) start = limit - size;
+    if (start < 0) start = 0;
+    return start;
+}
+
+// Helper private function drawing cell 'index' if it is in the viewport, returns whether it was drawn
+static int draw_cell(board_t* board, int64_t index) {
+    int x = cell_x(board, index) - view_x;
+    int y = cell_y(board, index) - view_y;
+    if (x < 0 || x >= view_w || y < 0 || y >= view_h) return 0;
+
+    char glyph = test_cell(board, PLANE_WALLS, index)     ? map_glyphs[1]
+                 : test_cell(board, PLANE_PORTALS, index) ? map_glyphs[2]
+                 : test_cell(board, PLANE_DOTS, index)    ? map_glyphs[3]
+                                                          : map_glyphs[0];
+    uint32_t occupant = atomic_load_explicit(cell_occupancy(board, index), memory_order_relaxed);
+    mvaddch(BOARD_START_ROW + y, x, cell_look(board, occupant, glyph));
+    return 1;
+}
+
+// Helper private function drawing the part of row 'y' in the viewport, the map is expanded from the planes
+// a tile at a time and the tiles that are all walls are never allocated
+static void draw_row(board_t* board, int y) {
+    int first_tile = view_x >> TILE_SHIFT;
+    int last_tile = (view_x + view_w - 1) >> TILE_SHIFT;
+    int span = (last_tile - first_tile + 1) * TILE_SIZE;
+    if (span > row_capacity) {
+        free(row_looks);
+        row_looks = malloc(span * sizeof(chtype));
+        if (row_looks == NULL) {
+            // The row is left as it was, the next frame tries again
+            debug("Display: cannot allocate a row of %d cells\n", span);
+            row_capacity = 0;
+            return;
+        }
+        row_capacity = span;
+    }
+
+    tile_t* const* tiles = &board->tiles[(int64_t)(y >> TILE_SHIFT) * board->tiles_x];
+    int row = y & TILE_MASK;
+    char glyphs[TILE_SIZE];
+    for (int tx = first_tile; tx <= last_tile; tx++) {
+        chtype* looks = row_looks + (tx - first_tile) * TILE_SIZE;
+        const tile_t* tile = tiles[tx];
+        if (tile == NULL) {
+            chtype wall = cell_look(board, OCC_EMPTY, map_glyphs[1]);
+            for (int x = 0; x < TILE_SIZE; x++) looks[x] = wall;
+            continue;
+        }
+
+        expand_row(&tile->planes[PLANE_WALLS][row], &tile->planes[PLANE_PORTALS][row], &tile->planes[PLANE_DOTS][row],
+                   TILE_SIZE, map_glyphs, glyphs);
+        const _Atomic uint32_t* occupancy = &tile->occupancy[row * TILE_SIZE];
+        for (int x = 0; x < TILE_SIZE; x++) {
+            looks[x] = cell_look(board, atomic_load_explicit(&occupancy[x], memory_order_relaxed), glyphs[x]);
+        }
+    }
+    mvaddchnstr(BOARD_START_ROW + y - view_y, 0, row_looks + (view_x & TILE_MASK), view_w);
+}
+
+// Helper private function for how a cell looks: its entity if it has one, otherwise the map glyph in its colour
+static chtype cell_look(board_t* board, uint32_t occupant, char glyph) {
+    if (occupant & OCC_PACMAN) return 'C' | COLOR_PAIR(1) | A_BOLD;
+    if (occupant & OCC_GHOST) {
+        int ghost_charged = board->ghosts[occupant & OCC_ID_MASK].charged;
+        return 'M' | COLOR_PAIR(2) | A_BOLD | (ghost_charged ? A_DIM : 0);
+    }
+    switch (glyph) {
+        case '#': return '#' | COLOR_PAIR(3);
+        case '@': return '@' | COLOR_PAIR(6);
+        case '.': return '.' | COLOR_PAIR(4);
+        default:  return ' ';
+    }
+}
+
+void take_render_stats(long* frames, long* cells) {
+    *frames = frames_drawn;
+    *cells = cells_drawn;
+    frames_drawn = 0;
+    cells_drawn = 0;
+}
+
 void draw(char c, int colour_i, int pos_x, int pos_y) {
     move(pos_y, pos_x);
     attron(COLOR_PAIR(colour_i) | A_BOLD);
@@ -152,7 +258,7 @@ void refresh_screen() {
 
 
 void screen_refresh(board_t * game_board, int mode) {
-    debug("REFRESH\n");
+    debug_hot("REFRESH\n");
     draw_board(game_board, mode);
     refresh_screen();      
 }
@@ -175,6 +281,9 @@ char get_input() {
         case 'D':
         case 'Q':
         case 'G':
+        case 'L':
+        case 'Z':
+        case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
 
             return (char)ch;
         
@@ -186,4 +295,7 @@ char get_input() {
 void terminal_cleanup() {
     // Restore terminal settings and clean up ncurses
     endwin();
+    free(row_looks);
+    row_looks = NULL;
+    row_capacity = 0;
 }
@@ -0,0 +1,68 @@
+#include "frame.h"
+#include "histogram.h"
+#include "utils.h"
+#include <errno.h>
+#include <time.h>
+
+
+static histogram_t jitter = {.min = UINT64_MAX};  // |start-to-start period - period| of every frame, in ns
+static long long target_period_ns = 0;
+static long total_frames = 0;
+static long dropped_frames = 0;
+
+
+void frame_clock_start(frame_clock_t* clock, long long period_ns) {
+    clock->period_ns = period_ns;
+    clock->deadline_ns = monotonic_ns();
+    clock->last_start_ns = 0;
+    target_period_ns = period_ns;
+}
+
+void frame_clock_wait(frame_clock_t* clock) {
+    // A level with TEMPO 0 plays as fast as it can, there is no deadline to keep or frame to drop
+    if (clock->period_ns <= 0) {
+        total_frames++;
+        return;
+    }
+
+    long long now = monotonic_ns();
+
+    if (now < clock->deadline_ns) {
+        if (clock->deadline_ns - now > FRAME_SPIN_NS) {
+            long long wake_ns = clock->deadline_ns - FRAME_SPIN_NS;
+            struct timespec wake = {wake_ns / 1000000000LL, wake_ns % 1000000000LL};
+            // A signal only cuts the sleep short, any other error is left to the spin below
+            int error;
+            while ((error = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL)) == EINTR);
+            if (error != 0) debug("Frame clock: clock_nanosleep failed with error %d\n", error);
+        }
+        while ((now = monotonic_ns()) < clock->deadline_ns);
+    }
+
+    if (clock->last_start_ns > 0) {
+        long long period = now - clock->last_start_ns;
+        long long deviation = period > clock->period_ns ? period - clock->period_ns : clock->period_ns - period;
+        hist_record(&jitter, (uint64_t)deviation);
+    }
+    clock->last_start_ns = now;
+    total_frames++;
+
+    clock->deadline_ns += clock->period_ns;
+    long long lag = now - clock->deadline_ns;
+    if (lag > FRAME_MAX_LAG * clock->period_ns) {
+        long behind = (long)(lag / clock->period_ns);
+        dropped_frames += behind;
+        clock->deadline_ns += behind * clock->period_ns;
+        debug("Frame clock: %ld frames dropped\n", behind);
+    }
+}
+
+void frame_report(FILE* out) {
+    if (jitter.count == 0) return;
+
+    fprintf(out, "Frame jitter over %ld frames (%ld dropped, last period %.3f ms): "
+                 "p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+            total_frames, dropped_frames, target_period_ns / 1e6,
+            hist_percentile(&jitter, 50) / 1e3, hist_percentile(&jitter, 90) / 1e3,
+            hist_percentile(&jitter, 99) / 1e3, hist_percentile(&jitter, 99.9) / 1e3, jitter.max / 1e3);
+}
@@ -2,50 +2,184 @@
 #include "utils.h"
 #include "board.h"
 #include "display.h"
+#include "kernels.h"
+#include "bundle.h"
+#include "loader.h"
+#include "replay.h"
+#include "frame.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "autosave.h"
+#include "journal.h"
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <pthread.h>
 
 
+static const char* level_result_name(int level_result, int won) {
+    if (won) return "won";
+    switch (level_result) {
+        case QUIT_GAME:          return "game over";
+        case QUIT_GAME_FORCED:   return "quit";
+        case BACKUP_WON_GAME:    return "won (backup)";
+        case TURN_LIMIT_REACHED: return "turn limit reached";
+        default:                 return "unknown";
+    }
+}
+
+static void print_summary(board_t* game_board, int levels_played, int points, uint64_t hash, long long elapsed_ns) {
+    double seconds = elapsed_ns / 1e9;
+    int won = game_board->level_result == NEXT_LEVEL && game_board->current_level > game_board->n_levels;
+    long long hidden_ns, waited_ns;
+    prefetch_stats(&hidden_ns, &waited_ns);
+
+    printf("=== PACMANIST SUMMARY ===\n"
+           "Result: %s\n"
+           "Engine: %s, seed %u\n"
+           "Levels played: %d (last level %d of %d)\n"
+           "Points: %d\n"
+           "Final board hash: %016llx\n"
+           "Turns: %ld\n"
+           "Elapsed: %.3f s\n"
+           "Turns per second: %.0f\n"
+           "Level loads hidden by the loader: %.3f ms, waited for: %.3f ms\n",
+           level_result_name(game_board->level_result, won),
+           game_board->opts->engine == ENGINE_SERIAL ? "serial" : "pool", game_board->opts->seed,
+           levels_played, game_board->current_level - (won ? 1 : 0), game_board->n_levels,
+           points, (unsigned long long)hash, game_board->total_turns, seconds,
+           seconds > 0 ? game_board->total_turns / seconds : 0.0,
+           hidden_ns / 1e6, waited_ns / 1e6);
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("Usage: %s <level_directory>\n", argv[0]);
+    game_options_t options;
+    if (parse_options(argc, argv, &options) != 0) {
+        print_usage(argv[0]);
         exit(1);
     }
 
-    // Random seed for any random movements
-    srand((unsigned int)time(NULL));
-
     open_debug_file("debug.log");
+    set_log_level(options.log_level);
+
+    // A replay brings the seed of the recorded game
+    if (options.replay_path != NULL && replay_open(options.replay_path, &options) != 0) {
+        exit(1);
+    }
+
+    // An autosave brings the seed, the level and the turn of the saved game
+    autosave_header_t saved;
+    void* saved_snapshot = NULL;
+    if (options.resume) {
+        saved_snapshot = autosave_load(options.autosave_path, &saved);
+        if (saved_snapshot == NULL) exit(1);
+        options.seed = saved.seed;
+        options.has_seed = 1;
+    }
+
+    // Master seed of the random movements, every entity seeds its own generator from it
+    if (!options.has_seed) options.seed = (unsigned int)time(NULL);
+    debug("Random seed: %u\n", options.seed);
+
+    if (options.record_path != NULL && record_open(options.record_path, &options) != 0) {
+        fprintf(stderr, "Cannot create replay file %s\n", options.record_path);
+        exit(1);
+    }
+
+    if (options.profile) profiler_init();
+    if (options.journal_kb > 0 && journal_init((size_t)options.journal_kb * 1024) != 0) {
+        debug("Cannot allocate the rewind journal, rewinding is disabled\n");
+    }
+
+    kernels_init();
+    debug("Level loader kernels: %s\n", kernels_isa());
 
-    terminal_init();
+    if (!options.headless) terminal_init();
     
     board_t game_board;
     int accumulated_points = 0;
+    int levels_played = 0;
+    uint64_t final_hash = 0;
     bool end_game = false;
 
-    strncpy(game_board.assets_dir, argv[1], MAX_DIRNAME);
-    game_board.has_saved = 0;
-    game_board.is_backup_instance = 0;
+    memset(&game_board, 0, sizeof(game_board));
+    strncpy(game_board.assets_dir, options.levels_path, MAX_DIRNAME - 1);
+    game_board.opts = &options;
 
-    parse_levels_directory(&game_board);
+    bundle_t bundle;
+    if (is_bundle_path(options.levels_path)) {
+        if (bundle_open(&bundle, options.levels_path) != 0) {
+            if (!options.headless) terminal_cleanup();
+            exit(1);
+        }
+        game_board.bundle = &bundle;
+        game_board.n_levels = bundle.header->n_levels;
+        game_board.current_level = 1;
+    } else {
+        parse_levels_directory(&game_board);
+    }
+
+    if (saved_snapshot != NULL) {
+        if (saved.level < 1 || saved.level > game_board.n_levels) {
+            if (!options.headless) terminal_cleanup();
+            fprintf(stderr, "The autosave is of level %d, there are %d levels\n", saved.level, game_board.n_levels);
+            exit(1);
+        }
+        game_board.current_level = saved.level;
+    }
+    if (options.autosave_path != NULL && autosave_start(options.autosave_path) != 0) {
+        if (!options.headless) terminal_cleanup();
+        fprintf(stderr, "Cannot start the autosave\n");
+        exit(1);
+    }
+
+    long long start_ns = monotonic_ns();
 
     while (!end_game && game_board.current_level <= game_board.n_levels) {
         game_board.play_result = CONTINUE;
         game_board.level_result = CONTINUE_PLAY;
-        load_level(&game_board, accumulated_points);
-        screen_refresh(&game_board, DRAW_MENU);
+
+        // Normally the level was already loaded in the background while the previous one was played
+        if (prefetch_take(&game_board, game_board.current_level, accumulated_points) != 0 &&
+            load_level(&game_board, accumulated_points) != 0) {
+            if (!options.headless) terminal_cleanup();
+            fprintf(stderr, "Cannot load level %d, see debug.log\n", game_board.current_level);
+            exit(1);
+        }
+        if (game_board.current_level < game_board.n_levels) {
+            prefetch_level(&game_board, game_board.current_level + 1);
+        }
+
+        if (saved_snapshot != NULL) {
+            if (strcmp(saved.level_file, game_board.level_file) != 0 ||
+                snapshot_decode(&game_board, saved_snapshot, saved.snapshot_size) != 0) {
+                if (!options.headless) terminal_cleanup();
+                fprintf(stderr, "The autosave does not match level %s\n", game_board.level_file);
+                exit(1);
+            }
+            game_board.total_turns = saved.total_turns;
+            debug("Resumed %s at turn %ld from %s\n", game_board.level_file, game_board.total_turns,
+                  options.autosave_path);
+            free(saved_snapshot);
+            saved_snapshot = NULL;
+        }
+
+        if (!options.headless) screen_refresh(&game_board, DRAW_MENU);
 
         play_level(&game_board);
+        levels_played++;
 
         if (game_board.level_result == NEXT_LEVEL) {
-            screen_refresh(&game_board, DRAW_WIN);
-            sleep_ms(2000);
+            if (!options.headless) {
+                screen_refresh(&game_board, DRAW_WIN);
+                sleep_ms(2000);
+            }
             game_board.current_level++;
         } else if (game_board.level_result == QUIT_GAME) {
-            screen_refresh(&game_board, DRAW_GAME_OVER);
-            sleep_ms(2000);
+            if (!options.headless) {
+                screen_refresh(&game_board, DRAW_GAME_OVER);
+                sleep_ms(2000);
+            }
             end_game = true;
         } else if (game_board.level_result == QUIT_GAME_FORCED) {
             debug("Main thread: User forced quit, exiting game.\n");
@@ -53,10 +187,15 @@ int main(int argc, char** argv) {
         } else if (game_board.level_result == BACKUP_WON_GAME) {
             debug("Main thread: Backup instance won the game, exiting.\n");
             end_game = true;
+        } else if (game_board.level_result == TURN_LIMIT_REACHED) {
+            debug("Main thread: Turn limit reached, exiting game.\n");
+            end_game = true;
         }
         
         accumulated_points = game_board.pacmans[0].points;
 
+        // The hash walks every row of the board, only the headless summary prints it
+        if (options.headless) final_hash = board_hash(&game_board);
         print_board(&game_board);
         unload_level(&game_board);
     }
@@ -67,11 +206,35 @@ int main(int argc, char** argv) {
         } else if (game_board.level_result == NEXT_LEVEL && game_board.current_level > game_board.n_levels) {
             game_board.level_result = BACKUP_WON_GAME;
         }
+        // The game ends with this process, otherwise its parent resumes it and keeps recording
+        if (game_board.level_result != CONTINUE_PLAY) record_close(game_board.total_turns);
+        autosave_stop();
         debug("Backup instance exiting with result %d.\n", game_board.level_result);
         exit(game_board.level_result);
     }
 
-    terminal_cleanup();
+    prefetch_close();
+    arena_destroy(&game_board.arena);
+    if (game_board.bundle != NULL) bundle_close(&bundle);
+    record_close(game_board.total_turns);
+    replay_close();
+    snapshot_free();
+    journal_free();
+    autosave_stop();
+    // Nothing is left to resume once the game is lost or won
+    if (game_board.level_result == QUIT_GAME || game_board.level_result == NEXT_LEVEL ||
+        game_board.level_result == BACKUP_WON_GAME) {
+        autosave_discard();
+    }
+
+    if (options.headless) {
+        print_summary(&game_board, levels_played, accumulated_points, final_hash, monotonic_ns() - start_ns);
+    } else {
+        terminal_cleanup();
+        frame_report(stdout);
+    }
+    prof_report(stdout);
+    autosave_report(stdout);
 
     close_debug_file();
 
@@ -0,0 +1,64 @@
+#include "histogram.h"
+#include <string.h>
+
+
+static inline int bucket_index(uint64_t value) {
+    if (value < HIST_SUB_BUCKETS) return (int)value;
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+    return (exponent - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+// Largest value that falls in bucket 'index'
+static uint64_t bucket_top(int index) {
+    if (index < HIST_SUB_BUCKETS) return (uint64_t)index;
+    int exponent = index / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(index % HIST_SUB_BUCKETS);
+    uint64_t bottom = (1ULL << exponent) | (sub << (exponent - HIST_SUB_BITS));
+    return bottom + (1ULL << (exponent - HIST_SUB_BITS)) - 1;
+}
+
+void hist_reset(histogram_t* hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+void hist_record(histogram_t* hist, uint64_t value) {
+    hist->buckets[bucket_index(value)]++;
+    hist->count++;
+    hist->sum += (double)value;
+    if (value < hist->min) hist->min = value;
+    if (value > hist->max) hist->max = value;
+}
+
+void hist_merge(histogram_t* hist, const histogram_t* other) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        hist->buckets[i] += other->buckets[i];
+    }
+    hist->count += other->count;
+    hist->sum += other->sum;
+    if (other->min < hist->min) hist->min = other->min;
+    if (other->max > hist->max) hist->max = other->max;
+}
+
+uint64_t hist_percentile(const histogram_t* hist, double percentile) {
+    if (hist->count == 0) return 0;
+
+    long rank = (long)(percentile / 100.0 * hist->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->count) rank = hist->count;
+
+    long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t top = bucket_top(i);
+            return top < hist->max ? top : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+double hist_mean(const histogram_t* hist) {
+    return hist->count > 0 ? hist->sum / hist->count : 0.0;
+}
@@ -0,0 +1,286 @@
+#include "journal.h"
+#include "utils.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define TRAILER_SIZE 8
+
+static void log_stats();
+static void drop_oldest();
+static unsigned char* reserve(size_t size);
+
+static unsigned char* data = NULL;  // turns live in [tail, head), or in [tail, wrap_end) and [0, head) once wrapped
+static size_t capacity = 0;
+static size_t head = 0;
+static size_t tail = 0;
+static size_t wrap_end = 0;
+static int wrapped = 0;
+static long n_turns = 0;
+
+static journal_entity_t* before = NULL;     // pre-images of the pacmans in the current turn
+static int n_before = 0;
+static journal_entity_t* changed = NULL;    // pre-images of the ghosts that changed in the current turn
+static int changed_capacity = 0;
+static atomic_int n_changed = 0;
+
+// Stats of the current level, logged when the next one begins
+static long turns_recorded = 0;
+static long long bytes_recorded = 0;
+static long turns_dropped = 0;
+
+
+int journal_init(size_t budget) {
+    data = malloc(budget);
+    if (data == NULL) return -1;
+    capacity = budget;
+    journal_clear();
+    return 0;
+}
+
+void journal_begin_level(const board_t* board) {
+    if (data == NULL) return;
+
+    log_stats();
+    journal_clear();
+
+    if (board->n_pacmans > n_before) {
+        journal_entity_t* grown = realloc(before, board->n_pacmans * sizeof(journal_entity_t));
+        if (grown == NULL) {
+            debug("Journal: cannot allocate %d pacman pre-images, disabled\n", board->n_pacmans);
+            journal_free();
+            return;
+        }
+        before = grown;
+        n_before = board->n_pacmans;
+    }
+    if (board->n_ghosts > changed_capacity) {
+        journal_entity_t* grown = realloc(changed, board->n_ghosts * sizeof(journal_entity_t));
+        if (grown == NULL) {
+            debug("Journal: cannot allocate %d ghost pre-images, disabled\n", board->n_ghosts);
+            journal_free();
+            return;
+        }
+        changed = grown;
+        changed_capacity = board->n_ghosts;
+    }
+}
+
+int journal_recording() {
+    return data != NULL;
+}
+
+void journal_begin_turn(const board_t* board) {
+    if (data == NULL) return;
+
+    // Ghosts may kill a pacman while it is not playing, so only the pacmans are taken before the turn
+    for (int i = 0; i < board->n_pacmans; i++) {
+        journal_capture(board, i, &before[i]);
+    }
+    atomic_store_explicit(&n_changed, 0, memory_order_relaxed);
+}
+
+void journal_ghost_played(const board_t* board, const journal_entity_t* pre) {
+    journal_entity_t after;
+    journal_capture(board, pre->entity, &after);
+    if (memcmp(pre, &after, sizeof(after)) != 0) {
+        int slot = atomic_fetch_add_explicit(&n_changed, 1, memory_order_relaxed);
+        changed[slot] = *pre;
+    }
+}
+
+void journal_dot(int pacman_id, int64_t index) {
+    if (data == NULL) return;
+    before[pacman_id].dot = index;
+}
+
+void journal_end_turn(const board_t* board) {
+    if (data == NULL) return;
+
+    // Only the entities that changed go into the ring, the ghosts already sorted themselves out while playing
+    int n_pacmans = 0;
+    for (int i = 0; i < board->n_pacmans; i++) {
+        journal_entity_t after;
+        journal_capture(board, i, &after);
+        if (before[i].dot >= 0 || memcmp(&before[i], &after, sizeof(after)) != 0) {
+            if (n_pacmans != i) before[n_pacmans] = before[i];
+            n_pacmans++;
+        }
+    }
+    int n_ghosts = atomic_load_explicit(&n_changed, memory_order_relaxed);
+    int n_entities = n_pacmans + n_ghosts;
+
+    size_t size = sizeof(journal_turn_t) + n_entities * sizeof(journal_entity_t) + TRAILER_SIZE;
+    unsigned char* turn = reserve(size);
+    if (turn == NULL) {
+        debug("Journal: a turn of %zu bytes does not fit in %zu\n", size, capacity);
+        journal_clear();
+        return;
+    }
+
+    journal_turn_t* header = (journal_turn_t*)turn;
+    header->size = (uint32_t)size;
+    header->n_entities = n_entities;
+    journal_entity_t* entities = (journal_entity_t*)(header + 1);
+    memcpy(entities, before, n_pacmans * sizeof(journal_entity_t));
+    memcpy(entities + n_pacmans, changed, n_ghosts * sizeof(journal_entity_t));
+    memcpy(turn + size - TRAILER_SIZE, &header->size, sizeof(header->size));
+
+    n_turns++;
+    turns_recorded++;
+    bytes_recorded += size;
+}
+
+int journal_rewind(board_t* board, int turns) {
+    if (data == NULL) return 0;
+
+    long long start_ns = monotonic_ns();
+    int undone = 0;
+    while (undone < turns && n_turns > 0) {
+        if (wrapped && head == 0) {
+            head = wrap_end;
+            wrapped = 0;
+        }
+        uint32_t size;
+        memcpy(&size, data + head - TRAILER_SIZE, sizeof(size));
+        head -= size;
+
+        const journal_turn_t* header = (const journal_turn_t*)(data + head);
+        const journal_entity_t* entities = (const journal_entity_t*)(header + 1);
+        for (uint32_t i = 0; i < header->n_entities; i++) {
+            const journal_entity_t* e = &entities[i];
+            if (e->entity < board->n_pacmans) {
+                pacman_t* pacman = &board->pacmans[e->entity];
+                pacman->pos_x = e->pos_x;
+                pacman->pos_y = e->pos_y;
+                pacman->points = e->points;
+                atomic_store(&pacman->alive, e->alive);
+                pacman->current_move = e->current_move;
+                pacman->waiting = e->waiting;
+                if (pacman->n_moves > 0) pacman->moves[e->current_move % pacman->n_moves].turns_left = e->turns_left;
+                pacman->rng = e->rng;
+                if (e->dot >= 0) {
+                    set_cell(board, PLANE_DOTS, e->dot);
+                    mark_dirty(board, e->dot);
+                }
+            } else {
+                ghost_t* ghost = &board->ghosts[e->entity - board->n_pacmans];
+                ghost->pos_x = e->pos_x;
+                ghost->pos_y = e->pos_y;
+                ghost->charged = e->charged;
+                ghost->current_move = e->current_move;
+                ghost->waiting = e->waiting;
+                if (ghost->n_moves > 0) ghost->moves[e->current_move % ghost->n_moves].turns_left = e->turns_left;
+                ghost->rng = e->rng;
+            }
+        }
+
+        n_turns--;
+        if (n_turns == 0) journal_clear();
+        undone++;
+    }
+
+    if (undone > 0) {
+        rebuild_occupancy(board);
+        debug("Journal: rewound %d turns in %.3f ms, %ld left\n", undone, (monotonic_ns() - start_ns) / 1e6, n_turns);
+    }
+    return undone;
+}
+
+void journal_clear() {
+    head = 0;
+    tail = 0;
+    wrap_end = 0;
+    wrapped = 0;
+    n_turns = 0;
+}
+
+void journal_free() {
+    log_stats();
+    free(data);
+    free(before);
+    free(changed);
+    data = NULL;
+    before = NULL;
+    changed = NULL;
+    capacity = 0;
+    n_before = 0;
+    changed_capacity = 0;
+    journal_clear();
+}
+
+void journal_capture(const board_t* board, int entity, journal_entity_t* out) {
+    memset(out, 0, sizeof(*out));
+    out->entity = entity;
+    out->dot = -1;
+    if (entity < board->n_pacmans) {
+        const pacman_t* pacman = &board->pacmans[entity];
+        out->pos_x = pacman->pos_x;
+        out->pos_y = pacman->pos_y;
+        out->points = pacman->points;
+        out->alive = atomic_load(&pacman->alive);
+        out->current_move = pacman->current_move;
+        out->waiting = pacman->waiting;
+        if (pacman->n_moves > 0) out->turns_left = pacman->moves[pacman->current_move % pacman->n_moves].turns_left;
+        out->rng = pacman->rng;
+    } else {
+        const ghost_t* ghost = &board->ghosts[entity - board->n_pacmans];
+        out->pos_x = ghost->pos_x;
+        out->pos_y = ghost->pos_y;
+        out->charged = ghost->charged;
+        out->current_move = ghost->current_move;
+        out->waiting = ghost->waiting;
+        if (ghost->n_moves > 0) out->turns_left = ghost->moves[ghost->current_move % ghost->n_moves].turns_left;
+        out->rng = ghost->rng;
+    }
+}
+
+// Helper private function logging how much the turns of the last level took, then resetting the counts
+static void log_stats() {
+    if (turns_recorded > 0) {
+        debug("Journal: %ld turns, %lld bytes (%.1f per turn), %ld dropped, %ld still held in %zu bytes\n",
+              turns_recorded, bytes_recorded, (double)bytes_recorded / turns_recorded, turns_dropped, n_turns,
+              capacity);
+    }
+    turns_recorded = 0;
+    bytes_recorded = 0;
+    turns_dropped = 0;
+}
+
+// Helper private function forgetting the oldest turn to make room
+static void drop_oldest() {
+    uint32_t size = ((const journal_turn_t*)(data + tail))->size;
+    tail += size;
+    if (wrapped && tail == wrap_end) {
+        tail = 0;
+        wrapped = 0;
+    }
+    n_turns--;
+    turns_dropped++;
+    if (n_turns == 0) journal_clear();
+}
+
+// Helper private function finding 'size' contiguous bytes for a new turn, dropping the oldest ones
+static unsigned char* reserve(size_t size) {
+    if (size > capacity) return NULL;
+
+    for (;;) {
+        if (!wrapped) {
+            if (capacity - head >= size) break;
+            // Turns never wrap around the end of the ring, the next one starts over at the beginning
+            wrap_end = head;
+            head = 0;
+            wrapped = 1;
+            if (n_turns == 0) journal_clear();
+        } else if (tail - head >= size) {
+            break;
+        } else {
+            drop_oldest();
+        }
+    }
+
+    unsigned char* turn = data + head;
+    head += size;
+    return turn;
+}
@@ -0,0 +1,308 @@
+#include "kernels.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+
+#define BYTE_SPREAD 0x0101010101010101ULL  // times a byte, copies it into the 8 bytes of a word
+
+// Kernels of one instruction set, the bitplane ones only see whole 64-bit words
+typedef struct {
+    const char* name;
+    void (*classify)(const char* bytes, map_masks_t* masks);
+    size_t (*count)(const uint64_t* words, size_t n_words);
+    void (*expand)(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                   const char glyphs[4], char* out);
+    size_t (*diff)(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from);
+} kernel_set_t;
+
+static void classify_scalar(const char* bytes, map_masks_t* masks);
+static size_t count_scalar(const uint64_t* words, size_t n_words);
+static void expand_scalar(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                          const char glyphs[4], char* out);
+static size_t diff_scalar(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from);
+
+#ifdef KERNELS_X86
+static void classify_sse2(const char* bytes, map_masks_t* masks);
+static size_t count_sse2(const uint64_t* words, size_t n_words);
+static void expand_sse2(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                        const char glyphs[4], char* out);
+static size_t diff_sse2(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from);
+static void classify_avx2(const char* bytes, map_masks_t* masks);
+static size_t count_avx2(const uint64_t* words, size_t n_words);
+static void expand_avx2(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                        const char glyphs[4], char* out);
+static size_t diff_avx2(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from);
+#endif
+
+static const kernel_set_t kernel_sets[] = {
+    {"scalar", classify_scalar, count_scalar, expand_scalar, diff_scalar},
+#ifdef KERNELS_X86
+    {"sse2", classify_sse2, count_sse2, expand_sse2, diff_sse2},
+    {"avx2", classify_avx2, count_avx2, expand_avx2, diff_avx2},
+#endif
+};
+
+static const kernel_set_t* active = &kernel_sets[0];
+
+
+static void classify_scalar(const char* bytes, map_masks_t* masks) {
+    uint64_t walls = 0, dots = 0, portals = 0;
+    for (int i = 0; i < MAP_BLOCK; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        if (bytes[i] == 'X') walls |= bit;
+        else if (bytes[i] == 'o') dots |= bit;
+        else if (bytes[i] == '@') portals |= bit;
+    }
+    masks->walls = walls;
+    masks->dots = dots;
+    masks->portals = portals;
+}
+
+static size_t count_scalar(const uint64_t* words, size_t n_words) {
+    size_t count = 0;
+    for (size_t i = 0; i < n_words; i++) {
+        count += __builtin_popcountll(words[i]);
+    }
+    return count;
+}
+
+static void expand_scalar(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                          const char glyphs[4], char* out) {
+    for (size_t w = 0; w < n_words; w++) {
+        for (int i = 0; i < 64; i++) {
+            int glyph = ((walls[w] >> i) & 1) ? 1 : ((portals[w] >> i) & 1) ? 2 : ((dots[w] >> i) & 1) ? 3 : 0;
+            *out++ = glyphs[glyph];
+        }
+    }
+}
+
+static size_t diff_scalar(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from) {
+    for (size_t i = from; i < n_words; i++) {
+        if (a[i] != b[i]) return i;
+    }
+    return n_words;
+}
+
+#ifdef KERNELS_X86
+static void classify_sse2(const char* bytes, map_masks_t* masks) {
+    const __m128i wall = _mm_set1_epi8('X');
+    const __m128i dot = _mm_set1_epi8('o');
+    const __m128i portal = _mm_set1_epi8('@');
+    uint64_t walls = 0, dots = 0, portals = 0;
+
+    for (int i = 0; i < MAP_BLOCK; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+        walls |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, wall)) << i;
+        dots |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dot)) << i;
+        portals |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, portal)) << i;
+    }
+    masks->walls = walls;
+    masks->dots = dots;
+    masks->portals = portals;
+}
+
+static size_t count_sse2(const uint64_t* words, size_t n_words) {
+    // Bit counts of each byte with the usual halving masks, then summed by sad against zero
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 2 <= n_words; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(words + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi16(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi16(v, 4)), m4);
+        total = _mm_add_epi64(total, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return lanes[0] + lanes[1] + count_scalar(words + i, n_words - i);
+}
+
+// Helper private function turning 16 bits into 16 bytes, 0xff where the bit is set
+static inline __m128i spread_bits_sse2(uint64_t bits) {
+    const __m128i select = _mm_set1_epi64x((long long)0x8040201008040201ULL);
+    __m128i bytes = _mm_set_epi64x((long long)(((bits >> 8) & 0xff) * BYTE_SPREAD),
+                                   (long long)((bits & 0xff) * BYTE_SPREAD));
+    return _mm_cmpeq_epi8(_mm_and_si128(bytes, select), select);
+}
+
+static inline __m128i select_sse2(__m128i mask, __m128i yes, __m128i no) {
+    return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+
+static void expand_sse2(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                        const char glyphs[4], char* out) {
+    const __m128i empty = _mm_set1_epi8(glyphs[0]);
+    const __m128i wall = _mm_set1_epi8(glyphs[1]);
+    const __m128i portal = _mm_set1_epi8(glyphs[2]);
+    const __m128i dot = _mm_set1_epi8(glyphs[3]);
+
+    for (size_t w = 0; w < n_words; w++) {
+        for (int i = 0; i < 64; i += 16) {
+            // Lowest priority first, walls win over portals and portals over dots
+            __m128i v = select_sse2(spread_bits_sse2(dots[w] >> i), dot, empty);
+            v = select_sse2(spread_bits_sse2(portals[w] >> i), portal, v);
+            v = select_sse2(spread_bits_sse2(walls[w] >> i), wall, v);
+            _mm_storeu_si128((__m128i*)out, v);
+            out += 16;
+        }
+    }
+}
+
+static size_t diff_sse2(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from) {
+    size_t i = from;
+    for (; i + 2 <= n_words; i += 2) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) break;
+    }
+    return diff_scalar(a, b, n_words, i);
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char* bytes, map_masks_t* masks) {
+    const __m256i wall = _mm256_set1_epi8('X');
+    const __m256i dot = _mm256_set1_epi8('o');
+    const __m256i portal = _mm256_set1_epi8('@');
+    __m256i lo = _mm256_loadu_si256((const __m256i*)bytes);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(bytes + 32));
+
+    masks->walls = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, wall)) |
+                   (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, wall)) << 32;
+    masks->dots = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, dot)) |
+                  (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, dot)) << 32;
+    masks->portals = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, portal)) |
+                     (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, portal)) << 32;
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const uint64_t* words, size_t n_words) {
+    // Bit counts of each nibble looked up with a shuffle, then summed by sad against zero
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 4 <= n_words; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(words + i));
+        __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+                                         _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + count_scalar(words + i, n_words - i);
+}
+
+// Helper private function turning 32 bits into 32 bytes, 0xff where the bit is set
+__attribute__((target("avx2")))
+static inline __m256i spread_bits_avx2(uint64_t bits) {
+    const __m256i select = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+    __m256i bytes = _mm256_set_epi64x((long long)(((bits >> 24) & 0xff) * BYTE_SPREAD),
+                                      (long long)(((bits >> 16) & 0xff) * BYTE_SPREAD),
+                                      (long long)(((bits >> 8) & 0xff) * BYTE_SPREAD),
+                                      (long long)((bits & 0xff) * BYTE_SPREAD));
+    return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, select), select);
+}
+
+__attribute__((target("avx2")))
+static void expand_avx2(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t n_words,
+                        const char glyphs[4], char* out) {
+    const __m256i empty = _mm256_set1_epi8(glyphs[0]);
+    const __m256i wall = _mm256_set1_epi8(glyphs[1]);
+    const __m256i portal = _mm256_set1_epi8(glyphs[2]);
+    const __m256i dot = _mm256_set1_epi8(glyphs[3]);
+
+    for (size_t w = 0; w < n_words; w++) {
+        for (int i = 0; i < 64; i += 32) {
+            // Lowest priority first, walls win over portals and portals over dots
+            __m256i v = _mm256_blendv_epi8(empty, dot, spread_bits_avx2(dots[w] >> i));
+            v = _mm256_blendv_epi8(v, portal, spread_bits_avx2(portals[w] >> i));
+            v = _mm256_blendv_epi8(v, wall, spread_bits_avx2(walls[w] >> i));
+            _mm256_storeu_si256((__m256i*)out, v);
+            out += 32;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t diff_avx2(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from) {
+    size_t i = from;
+    for (; i + 8 <= n_words; i += 8) {
+        __m256i lo = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                      _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i hi = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 4)),
+                                      _mm256_loadu_si256((const __m256i*)(b + i + 4)));
+        __m256i any = _mm256_or_si256(lo, hi);
+        if (!_mm256_testz_si256(any, any)) break;
+    }
+    return diff_scalar(a, b, n_words, i);
+}
+#endif
+
+void kernels_init() {
+    // Without x86 neither is in the table and the scalar kernels stay
+    if (kernels_use("avx2") != 0) kernels_use("sse2");
+}
+
+int kernels_use(const char* isa) {
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "avx2") == 0 && !__builtin_cpu_supports("avx2")) return -1;
+#endif
+    for (size_t i = 0; i < sizeof(kernel_sets) / sizeof(kernel_sets[0]); i++) {
+        if (strcmp(kernel_sets[i].name, isa) == 0) {
+            active = &kernel_sets[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* kernels_isa() {
+    return active->name;
+}
+
+void classify_map_block(const char* bytes, size_t len, map_masks_t* masks) {
+    if (len >= MAP_BLOCK) {
+        active->classify(bytes, masks);
+        return;
+    }
+
+    // Short tail of a row: classify a padded copy so the kernels never read past the mapping
+    char block[MAP_BLOCK] = {0};
+    memcpy(block, bytes, len);
+    active->classify(block, masks);
+}
+
+size_t count_bits(const uint64_t* words, size_t n_words) {
+    return active->count(words, n_words);
+}
+
+void expand_row(const uint64_t* walls, const uint64_t* portals, const uint64_t* dots, size_t width,
+                const char glyphs[4], char* out) {
+    size_t full_words = width / 64;
+    active->expand(walls, portals, dots, full_words, glyphs, out);
+
+    // Partial last word of the row: expand it into a block and keep the cells that exist
+    size_t tail = width % 64;
+    if (tail > 0) {
+        char block[64];
+        active->expand(walls + full_words, portals + full_words, dots + full_words, 1, glyphs, block);
+        memcpy(out + full_words * 64, block, tail);
+    }
+}
+
+size_t next_diff(const uint64_t* a, const uint64_t* b, size_t n_words, size_t from) {
+    return active->diff(a, b, n_words, from);
+}
@@ -0,0 +1,149 @@
+#include "loader.h"
+#include "board.h"
+#include "utils.h"
+#include <pthread.h>
+#include <string.h>
+
+
+#define PREFETCH_IDLE 0     // nothing loaded or loading
+#define PREFETCH_RUNNING 1  // loader thread still running
+#define PREFETCH_READY 2    // level loaded and waiting to be taken
+
+static void* loader_thread(void* arg);
+static void move_level(board_t* dst, board_t* src);
+
+static pthread_t loader_tid;
+static int loader_state = PREFETCH_IDLE;
+static board_t staged;                  // board the loader thread loads the next level into
+static int staged_result = 0;           // what load_level returned for the staged level
+static long long total_hidden_ns = 0;
+static long long total_waited_ns = 0;
+
+
+int prefetch_level(const board_t* template, int level) {
+    prefetch_discard();
+
+    // The staged board keeps its own arena, reserved by its first level and swapped with the game's ever after
+    arena_t arena = staged.arena;
+    staged = *template;
+    staged.arena = arena;
+    staged.current_level = level;
+    staged.tiles = NULL;
+    staged.tile_list = NULL;
+    staged.n_tiles = 0;
+    staged.tile_capacity = 0;
+    staged.pacmans = NULL;
+    staged.ghosts = NULL;
+    staged.ghosts_files = NULL;
+    staged.lock_stripes = NULL;
+    staged.dirty_tiles = NULL;
+
+    if (pthread_create(&loader_tid, NULL, loader_thread, NULL) != 0) {
+        debug("Error creating loader thread for level %d.\n", level);
+        return -1;
+    }
+    loader_state = PREFETCH_RUNNING;
+    return 0;
+}
+
+void prefetch_wait() {
+    if (loader_state == PREFETCH_RUNNING) {
+        pthread_join(loader_tid, NULL);
+        loader_state = PREFETCH_READY;
+    }
+}
+
+int prefetch_take(board_t* board, int level, int points) {
+    if (loader_state == PREFETCH_IDLE) return -1;
+
+    long long start_ns = monotonic_ns();
+    prefetch_wait();
+    long long waited_ns = monotonic_ns() - start_ns;
+
+    if (staged.current_level != level) {
+        debug("Prefetched level %d is not the requested level %d, discarding it\n", staged.current_level, level);
+        prefetch_discard();
+        return -1;
+    }
+    if (staged_result != 0) {
+        debug("Prefetched level %d failed to load, discarding it\n", level);
+        prefetch_discard();
+        return -1;
+    }
+
+    move_level(board, &staged);
+    board->pacmans[0].points += points;
+    loader_state = PREFETCH_IDLE;
+
+    long long hidden_ns = board->load_stats.ns > waited_ns ? board->load_stats.ns - waited_ns : 0;
+    total_hidden_ns += hidden_ns;
+    total_waited_ns += waited_ns;
+    debug("Level %d taken from the loader: %.3f ms of loading hidden, %.3f ms waiting for the loader\n",
+          level, hidden_ns / 1e6, waited_ns / 1e6);
+    return 0;
+}
+
+void prefetch_discard() {
+    prefetch_wait();
+    if (loader_state == PREFETCH_READY) {
+        unload_level(&staged);
+        loader_state = PREFETCH_IDLE;
+    }
+}
+
+void prefetch_close() {
+    prefetch_discard();
+    arena_destroy(&staged.arena);
+}
+
+void prefetch_stats(long long* hidden_ns, long long* waited_ns) {
+    *hidden_ns = total_hidden_ns;
+    *waited_ns = total_waited_ns;
+}
+
+static void* loader_thread(void* arg) {
+    (void)arg;
+    debug("Loader thread: loading level %d\n", staged.current_level);
+    staged_result = load_level(&staged, 0);
+    return NULL;
+}
+
+// Hands the level data of 'src' over to 'dst', only the pointers to the big arrays are copied. The arenas are
+// swapped: 'src' gets the reset arena of 'dst' to load its next level into.
+static void move_level(board_t* dst, board_t* src) {
+    arena_t arena = dst->arena;
+    dst->current_level = src->current_level;
+    dst->width = src->width;
+    dst->height = src->height;
+    dst->tiles_x = src->tiles_x;
+    dst->tiles_y = src->tiles_y;
+    dst->tiles = src->tiles;
+    dst->tile_list = src->tile_list;
+    dst->n_tiles = src->n_tiles;
+    dst->tile_capacity = src->tile_capacity;
+    dst->arena = src->arena;
+    dst->n_pacmans = src->n_pacmans;
+    dst->pacmans = src->pacmans;
+    dst->n_ghosts = src->n_ghosts;
+    dst->ghosts = src->ghosts;
+    dst->tempo_us = src->tempo_us;
+    dst->load_stats = src->load_stats;
+    dst->lock_stripes = src->lock_stripes;
+    dst->dirty_tiles = src->dirty_tiles;
+    atomic_store(&dst->n_dirty, atomic_load(&src->n_dirty));
+    dst->full_redraw = 1;
+    memcpy(dst->level_file, src->level_file, sizeof(dst->level_file));
+    memcpy(dst->pacman_file, src->pacman_file, sizeof(dst->pacman_file));
+    dst->ghosts_files = src->ghosts_files;
+
+    src->tiles = NULL;
+    src->tile_list = NULL;
+    src->n_tiles = 0;
+    src->tile_capacity = 0;
+    src->arena = arena;
+    src->pacmans = NULL;
+    src->ghosts = NULL;
+    src->ghosts_files = NULL;
+    src->lock_stripes = NULL;
+    src->dirty_tiles = NULL;
+}
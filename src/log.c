@@ -0,0 +1,298 @@
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+
+#define RECORD_PADDING 0xFFFFFFFFu   // length of the filler record that sends the reader back to the start
+#define WRITER_IDLE_NS 1000000       // writer sleep when every ring is empty
+
+/*Header of each message in a ring, followed by 'length' bytes of text*/
+typedef struct {
+    uint32_t length;
+    uint32_t level;
+    long long timestamp_ns;
+} log_record_t;
+
+/*Single producer (its thread), single consumer (the writer thread) ring buffer*/
+typedef struct log_ring {
+    _Alignas(64) atomic_size_t head;    // bytes ever written, advanced by the producer
+    _Alignas(64) atomic_size_t tail;    // bytes ever consumed, advanced by the writer
+    atomic_long dropped;                // messages that did not fit
+    atomic_int closed;                  // the producer thread exited
+    struct log_ring* next;              // next ring in the registry
+    size_t drain_tail, drain_head;      // records the current drain still has to merge, writer only
+    char data[LOG_RING_SIZE];
+} log_ring_t;
+
+static void* writer_thread(void* arg);
+static log_ring_t* thread_ring();
+static void release_ring(void* ring);
+static int drain_rings();
+static log_record_t* pending_record(log_ring_t* ring);
+static void start_writer();
+static void prepare_fork();
+static void parent_after_fork();
+static void child_after_fork();
+
+static FILE* debugfile = NULL;
+static atomic_int log_level = LOG_TRACE;
+static long long opened_ns;
+static long long last_written_ns;           // timestamp of the newest record written, the drops are reported at it
+
+static _Atomic(log_ring_t*) rings = NULL;   // every ring ever registered, newest first
+static _Thread_local log_ring_t* my_ring = NULL;
+static pthread_key_t ring_key;              // its destructor marks the ring of an exiting thread as closed
+
+static pthread_t writer_tid;
+static atomic_int writer_running = 0;
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+void open_debug_file(char *filename) {
+    debugfile = fopen(filename, "w");
+    if (debugfile == NULL) return;
+
+    opened_ns = monotonic_ns();
+    last_written_ns = opened_ns;
+    pthread_key_create(&ring_key, release_ring);
+    pthread_atfork(prepare_fork, parent_after_fork, child_after_fork);
+    atexit(close_debug_file);
+    start_writer();
+}
+
+void close_debug_file() {
+    if (debugfile == NULL) return;
+
+    if (atomic_exchange(&writer_running, 0)) {
+        pthread_join(writer_tid, NULL);
+    }
+
+    pthread_mutex_lock(&drain_mutex);
+    drain_rings();
+    fclose(debugfile);
+    debugfile = NULL;
+    pthread_mutex_unlock(&drain_mutex);
+}
+
+void set_log_level(log_level_t level) {
+    atomic_store(&log_level, level);
+}
+
+int parse_log_level(const char* name) {
+    static const char* names[] = {"error", "warn", "info", "debug", "trace"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static void vlog_write(log_level_t level, const char* format, va_list args) {
+    if (debugfile == NULL || (int)level > atomic_load_explicit(&log_level, memory_order_relaxed)) return;
+
+    log_ring_t* ring = thread_ring();
+    if (ring == NULL) return;
+
+    char text[LOG_MAX_MESSAGE];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    if (length < 0) return;
+    if (length >= (int)sizeof(text)) length = sizeof(text) - 1;
+
+    size_t needed = (sizeof(log_record_t) + length + 7) & ~(size_t)7;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t offset = head % LOG_RING_SIZE;
+    size_t to_end = LOG_RING_SIZE - offset;
+
+    // Records never wrap: if this one does not fit before the end, pad up to it and start over
+    size_t padding = to_end < needed ? to_end : 0;
+    while (head + padding + needed - tail > LOG_RING_SIZE) {
+        // Trace messages are lossy so the hot path never waits, anything else waits for the writer
+        if (level == LOG_TRACE || !atomic_load(&writer_running)) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        struct timespec backoff = {0, WRITER_IDLE_NS / 10};
+        nanosleep(&backoff, NULL);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+    if (padding > 0) {
+        ((log_record_t*)(ring->data + offset))->length = RECORD_PADDING;
+        head += padding;
+        offset = 0;
+    }
+
+    log_record_t* record = (log_record_t*)(ring->data + offset);
+    record->length = length;
+    record->level = level;
+    record->timestamp_ns = monotonic_ns();
+    memcpy(record + 1, text, length);
+
+    atomic_store_explicit(&ring->head, head + needed, memory_order_release);
+}
+
+void log_write(log_level_t level, const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog_write(level, format, args);
+    va_end(args);
+}
+
+void debug(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    vlog_write(LOG_DEBUG, format, args);
+    va_end(args);
+}
+
+// Returns the calling thread's ring, registering a new one on its first message
+static log_ring_t* thread_ring() {
+    if (my_ring != NULL) return my_ring;
+
+    log_ring_t* ring = aligned_alloc(64, sizeof(log_ring_t));
+    if (ring == NULL) return NULL;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->closed, 0);
+
+    ring->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &ring->next, ring));
+
+    my_ring = ring;
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+static void release_ring(void* ring) {
+    atomic_store(&((log_ring_t*)ring)->closed, 1);
+}
+
+// Writes out every pending record, frees drained rings of exited threads.
+// Returns the number of records written. Called with drain_mutex held.
+static int drain_rings() {
+    static const char level_tags[] = "EWIDT";
+    int written = 0;
+    log_ring_t* first = atomic_load(&rings);
+
+    // Each ring is in order on its own, the records published so far are merged by timestamp across them
+    for (log_ring_t* ring = first; ring != NULL; ring = ring->next) {
+        ring->drain_tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        ring->drain_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    for (;;) {
+        log_ring_t* oldest = NULL;
+        log_record_t* oldest_record = NULL;
+        for (log_ring_t* ring = first; ring != NULL; ring = ring->next) {
+            log_record_t* record = pending_record(ring);
+            if (record != NULL && (oldest == NULL || record->timestamp_ns < oldest_record->timestamp_ns)) {
+                oldest = ring;
+                oldest_record = record;
+            }
+        }
+        if (oldest == NULL) break;
+
+        fprintf(debugfile, "[%12.6f] %c ", (oldest_record->timestamp_ns - opened_ns) / 1e9,
+                level_tags[oldest_record->level]);
+        fwrite(oldest_record + 1, 1, oldest_record->length, debugfile);
+        last_written_ns = oldest_record->timestamp_ns;
+        oldest->drain_tail += (sizeof(log_record_t) + oldest_record->length + 7) & ~(size_t)7;
+        written++;
+    }
+
+    log_ring_t* prev = NULL;
+    log_ring_t* ring = first;
+    while (ring != NULL) {
+        // Read before the tail is given back: a ring closed now got its last record before the drain started
+        int closed = atomic_load(&ring->closed) && ring->drain_head == atomic_load(&ring->head);
+        atomic_store_explicit(&ring->tail, ring->drain_tail, memory_order_release);
+
+        long dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            fprintf(debugfile, "[%12.6f] W log ring full, dropped %ld messages\n",
+                    (last_written_ns - opened_ns) / 1e9, dropped);
+        }
+
+        log_ring_t* next = ring->next;
+        if (closed && prev != NULL) {
+            // Producers only ever push at the head, so any other ring can be unlinked safely
+            prev->next = next;
+            free(ring);
+        } else {
+            prev = ring;
+        }
+        ring = next;
+    }
+
+    return written;
+}
+
+// Next record of 'ring' the current drain has to write, past any padding, NULL if none is left
+static log_record_t* pending_record(log_ring_t* ring) {
+    while (ring->drain_tail != ring->drain_head) {
+        size_t offset = ring->drain_tail % LOG_RING_SIZE;
+        log_record_t* record = (log_record_t*)(ring->data + offset);
+        if (record->length != RECORD_PADDING) return record;
+        ring->drain_tail += LOG_RING_SIZE - offset;
+    }
+    return NULL;
+}
+
+static void* writer_thread(void* arg) {
+    (void)arg;
+    struct timespec idle = {0, WRITER_IDLE_NS};
+
+    while (atomic_load(&writer_running)) {
+        pthread_mutex_lock(&drain_mutex);
+        int written = drain_rings();
+        if (written == 0) fflush(debugfile);
+        pthread_mutex_unlock(&drain_mutex);
+
+        if (written == 0) nanosleep(&idle, NULL);
+    }
+
+    return NULL;
+}
+
+static void start_writer() {
+    atomic_store(&writer_running, 1);
+    if (pthread_create(&writer_tid, NULL, writer_thread, NULL) != 0) {
+        atomic_store(&writer_running, 0);
+    }
+}
+
+// Before fork: write everything out so neither process repeats or loses the pending messages
+static void prepare_fork() {
+    pthread_mutex_lock(&drain_mutex);
+    if (debugfile != NULL) {
+        drain_rings();
+        fflush(debugfile);
+    }
+}
+
+static void parent_after_fork() {
+    pthread_mutex_unlock(&drain_mutex);
+}
+
+// Only the forking thread exists in the child: the rings of the others were drained by prepare_fork and will
+// never be written again, and the writer thread is started anew
+static void child_after_fork() {
+    pthread_mutex_init(&drain_mutex, NULL);
+
+    log_ring_t* ring = atomic_load(&rings);
+    while (ring != NULL) {
+        log_ring_t* next = ring->next;
+        if (ring != my_ring) free(ring);
+        ring = next;
+    }
+    if (my_ring != NULL) my_ring->next = NULL;
+    atomic_store(&rings, my_ring);
+
+    if (debugfile != NULL && atomic_load(&writer_running)) {
+        start_writer();
+    }
+}
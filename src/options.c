@@ -0,0 +1,178 @@
+#include "options.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+int parse_options(int argc, char** argv, game_options_t* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->log_level = LOG_TRACE;
+    opts->autosave_every = AUTOSAVE_EVERY;
+    opts->journal_kb = JOURNAL_BUDGET_KB;
+    opts->arena_mb = ARENA_RESERVE_MB;
+
+    int opt;
+    char* end;
+    while ((opt = getopt(argc, argv, "Hn:p:j:e:l:b:CPs:v:r:R:A:a:cJ:M:T")) != -1) {
+        switch (opt) {
+            case 'H':
+                opts->headless = 1;
+                break;
+            case 'n':
+                opts->max_turns = strtol(optarg, &end, 10);
+                if (*end != '\0' || opts->max_turns < 0) {
+                    fprintf(stderr, "Invalid turn limit: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'p':
+                opts->pacman_file = optarg;
+                break;
+            case 'j':
+                opts->n_workers = (int)strtol(optarg, &end, 10);
+                if (*end != '\0' || opts->n_workers < 0) {
+                    fprintf(stderr, "Invalid number of workers: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'e':
+                if (strcmp(optarg, "pool") == 0) {
+                    opts->engine = ENGINE_POOL;
+                } else if (strcmp(optarg, "serial") == 0) {
+                    opts->engine = ENGINE_SERIAL;
+                } else {
+                    fprintf(stderr, "Unknown engine: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'l':
+                if (strcmp(optarg, "rwlock") == 0) {
+                    opts->locking = LOCKING_RWLOCK;
+                } else if (strcmp(optarg, "cas") == 0) {
+                    opts->locking = LOCKING_CAS;
+                } else if (strcmp(optarg, "stripe") == 0) {
+                    opts->locking = LOCKING_STRIPE;
+                } else {
+                    fprintf(stderr, "Unknown locking mode: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'b':
+                if (strcmp(optarg, "snapshot") == 0) {
+                    opts->backup = BACKUP_SNAPSHOT;
+                } else if (strcmp(optarg, "fork") == 0) {
+                    opts->backup = BACKUP_FORK;
+                } else {
+                    fprintf(stderr, "Unknown quicksave mode: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'C':
+                opts->contention = 1;
+                break;
+            case 'P':
+                opts->profile = 1;
+                break;
+            case 's':
+                opts->seed = (unsigned int)strtoul(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "Invalid seed: %s\n", optarg);
+                    return -1;
+                }
+                opts->has_seed = 1;
+                break;
+            case 'v':
+                opts->log_level = parse_log_level(optarg);
+                if (opts->log_level < 0) {
+                    fprintf(stderr, "Unknown log level: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'r':
+                opts->record_path = optarg;
+                break;
+            case 'R':
+                opts->replay_path = optarg;
+                opts->headless = 1;
+                break;
+            case 'A':
+                opts->autosave_path = optarg;
+                break;
+            case 'a':
+                opts->autosave_every = strtol(optarg, &end, 10);
+                if (*end != '\0' || opts->autosave_every <= 0) {
+                    fprintf(stderr, "Invalid autosave interval: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'c':
+                opts->resume = 1;
+                break;
+            case 'J':
+                opts->journal_kb = strtol(optarg, &end, 10);
+                if (*end != '\0' || opts->journal_kb < 0) {
+                    fprintf(stderr, "Invalid journal size: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'T':
+                opts->arena_hugetlb = 1;
+                break;
+            case 'M':
+                opts->arena_mb = strtol(optarg, &end, 10);
+                if (*end != '\0' || opts->arena_mb < 1) {
+                    fprintf(stderr, "Invalid arena size: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        return -1;
+    }
+    if (opts->record_path != NULL && opts->replay_path != NULL) {
+        fprintf(stderr, "Cannot record and replay at the same time\n");
+        return -1;
+    }
+    if (opts->resume && opts->autosave_path == NULL) {
+        fprintf(stderr, "Resuming needs the autosave file (-A)\n");
+        return -1;
+    }
+    if (opts->resume && opts->replay_path != NULL) {
+        fprintf(stderr, "Cannot resume an autosave while replaying\n");
+        return -1;
+    }
+
+    opts->levels_path = argv[optind];
+    return 0;
+}
+
+void print_usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [options] <level_directory | level_bundle>\n"
+            "  -H          headless: no ncurses, no frame sleeps, print a summary at exit\n"
+            "  -n <turns>  stop after <turns> turns (0 = no limit)\n"
+            "  -p <file>   pacman script to use in every level instead of the PAC file\n"
+            "  -j <n>      worker threads playing the entities (0 = one per core)\n"
+            "  -e <engine> pool (default) or serial: all entities in a fixed order on one thread\n"
+            "  -l <mode>   locking of the pool engine: rwlock (default), cas: lock-free moves or stripe\n"
+            "  -b <mode>   quicksave: snapshot (default): slots 1-9 in memory, or fork: a backup process\n"
+            "  -C          count lock contention per entity and per cell, reported in debug.log\n"
+            "  -P          profile the phases of each turn, printed at exit or to debug.log on SIGUSR1\n"
+            "  -s <seed>   seed for the random movements (default: current time)\n"
+            "  -v <level>  debug.log verbosity: error, warn, info, debug or trace (default)\n"
+            "  -r <file>   record the keys and the seed of the game into <file>\n"
+            "  -R <file>   replay a recorded game headless, as fast as possible\n"
+            "  -A <file>   autosave the game into <file> in the background\n"
+            "  -a <turns>  turns between two autosaves (default 100)\n"
+            "  -c          continue the game saved in the autosave file\n"
+            "  -J <KiB>    memory of the rewind journal (default 1024, 0 = no rewind)\n"
+            "  -M <MiB>    address space reserved for each level, the level fails to load past it (default 1024)\n"
+            "  -T          take the level reserves in explicit huge pages from the system pool, if it has enough\n",
+            prog);
+}
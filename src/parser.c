@@ -4,9 +4,19 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "parser.h"
 #include "board.h"
 #include "utils.h"
+#include "kernels.h"
+
+
+// Adds the open, reads and close of a parsed file to the level load statistics
+static void account_load(board_t* board, line_reader_t* reader) {
+    board->load_stats.syscalls += reader->n_syscalls + 2;
+    board->load_stats.bytes += reader->n_bytes;
+}
 
 int parse_levels_directory(board_t* board) {
     char* dir_path = board->assets_dir;
@@ -64,118 +74,295 @@ int parse_levels_directory(board_t* board) {
 }
 
 
+// Splits the next blank-separated token of [*cursor, end), returns its length or 0 at the end of the line
+static int next_token(const char** cursor, const char* end, const char** token) {
+    const char* p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    *token = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    *cursor = p;
+    return (int)(p - *token);
+}
+
+static int token_is(const char* token, int len, const char* word) {
+    return len == (int)strlen(word) && memcmp(token, word, len) == 0;
+}
+
+static int token_to_int(const char* token, int len) {
+    int value = 0;
+    for (int i = 0; i < len && token[i] >= '0' && token[i] <= '9'; i++) {
+        value = value * 10 + (token[i] - '0');
+    }
+    return value;
+}
+
+// Milliseconds with an optional fraction ("16.6", "0.5") to microseconds
+static int token_to_us(const char* token, int len) {
+    int value = 0;
+    int i = 0;
+    for (; i < len && token[i] >= '0' && token[i] <= '9'; i++) {
+        value = value * 10 + (token[i] - '0');
+    }
+    value *= 1000;
+    if (i < len && token[i] == '.') {
+        int scale = 100;
+        for (i++; i < len && token[i] >= '0' && token[i] <= '9' && scale > 0; i++, scale /= 10) {
+            value += (token[i] - '0') * scale;
+        }
+    }
+    return value;
+}
+
+// Turns the 'X', 'o' and '@' of a map row into board cells starting at cell 'filled', counted row-major,
+// other bytes are skipped. A row longer or shorter than the width carries on in the next one. Returns the
+// number of cells filled so far, or -1 if a tile could not be allocated.
+static int64_t fill_map_row(board_t* board, const char* row, int len, int64_t filled) {
+    int64_t n_cells = (int64_t)board->width * board->height;
+
+    for (int offset = 0; offset < len && filled < n_cells; offset += MAP_BLOCK) {
+        map_masks_t masks;
+        classify_map_block(row + offset, len - offset, &masks);
+        uint64_t cells = masks.walls | masks.dots | masks.portals;
+
+        // Tiles start as walls, so only the other cells are written and the wall-only tiles never get allocated
+        uint64_t open = masks.dots | masks.portals;
+        while (open != 0) {
+            int bit = __builtin_ctzll(open);
+            open &= open - 1;
+
+            int64_t cell = filled + __builtin_popcountll(cells & ((1ULL << bit) - 1));
+            if (cell >= n_cells) break;
+            int64_t index = cell_index(board, (int)(cell % board->width), (int)(cell / board->width));
+            if (ensure_tile(board, index) == NULL) return -1;
+            clear_cell(board, PLANE_WALLS, index);
+            if ((masks.dots >> bit) & 1) set_cell(board, PLANE_DOTS, index);
+            if ((masks.portals >> bit) & 1) set_cell(board, PLANE_PORTALS, index);
+        }
+        filled += __builtin_popcountll(cells);
+    }
+
+    return filled < n_cells ? filled : n_cells;
+}
+
+// Appends the files of the MON line [cursor, end) to the ghost files, in the level arena. The array grows by
+// the ghosts of the line, so a single MON line sizes it exactly. Returns 0 on success, -1 if out of memory.
+static int add_ghost_files(board_t* board, const char* cursor, const char* end) {
+    int n_files = 0;
+    const char* token;
+    for (const char* p = cursor; next_token(&p, end, &token) != 0; ) n_files++;
+    if (n_files == 0) return 0;
+
+    char** files = arena_alloc(&board->arena, (board->n_ghosts + n_files) * sizeof(char*));
+    if (files == NULL) return -1;
+    if (board->n_ghosts > 0) memcpy(files, board->ghosts_files, board->n_ghosts * sizeof(char*));
+    board->ghosts_files = files;
+
+    size_t dir_len = strlen(board->assets_dir);
+    for (int len = next_token(&cursor, end, &token); len != 0; len = next_token(&cursor, end, &token)) {
+        char* file = arena_alloc(&board->arena, dir_len + len + 1);
+        if (file == NULL) return -1;
+        memcpy(file, board->assets_dir, dir_len);
+        memcpy(file + dir_len, token, len);
+        board->ghosts_files[board->n_ghosts++] = file;
+    }
+    return 0;
+}
+
 int parse_level_file(board_t* board) {
     const char* filepath = board->level_file;
 
+    // Each call made is counted in the load statistics, failed ones too
     int fd = open(filepath, O_RDONLY);
+    board->load_stats.syscalls++;
     if (fd < 0) {
         perror("Error: Could not open level file.\n");
         return -1;
     }
+
+    struct stat st;
+    int stat_result = fstat(fd, &st);
+    board->load_stats.syscalls++;
+    if (stat_result < 0 || st.st_size == 0) {
+        perror("Error: Could not stat level file or it is empty.\n");
+        close(fd);
+        board->load_stats.syscalls++;
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    board->load_stats.syscalls += 2;
+    if (data == MAP_FAILED) {
+        perror("Error: Could not map level file.\n");
+        return -1;
+    }
+    posix_madvise((void*)data, size, POSIX_MADV_SEQUENTIAL);
+    board->load_stats.syscalls++;
+    board->load_stats.bytes += size;
     
     board->width = 0;
     board->height = 0;
     board->n_ghosts = 0;
     board->n_pacmans = 1;
-    board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
+    board->pacmans = arena_alloc(&board->arena, board->n_pacmans * sizeof(pacman_t));
     board->ghosts = NULL;
-    board->board = NULL;
+    board->ghosts_files = NULL;
+    board->tiles = NULL;
+    if (board->pacmans == NULL) {
+        munmap((void*)data, size);
+        board->load_stats.syscalls++;
+        perror("Error: Could not allocate the pacman.\n");
+        return -1;
+    }
+    board->n_tiles = 0;
     board->pacman_file[0] = '\0';
 
-    char line_buffer[LINE_BUFFER_SIZE];
-    int map_cell_index = 0; 
+    int64_t map_cell_index = 0;
+    const char* data_end = data + size;
 
-    while (read_line(fd, line_buffer, LINE_BUFFER_SIZE) > 0) {
-        if (strlen(line_buffer) == 0) continue;
-        if (line_buffer[0] == '#') continue;
+    // Directives are parsed straight from the mapping, nothing is copied or NUL-terminated
+    for (const char* line = data; line < data_end; ) {
+        const char* line_end = memchr(line, '\n', data_end - line);
+        if (line_end == NULL) line_end = data_end;
+        const char* next_line = line_end + 1;
 
-        char line_work[LINE_BUFFER_SIZE]; 
-        strcpy(line_work, line_buffer);      // Copy for tokenization because strtok modifies the string
+        if (line == line_end || line[0] == '#') {
+            line = next_line;
+            continue;
+        }
 
-        char* token = strtok(line_work, " \t\r");
-        if (token == NULL) continue;
+        const char* cursor = line;
+        const char* token;
+        int token_len = next_token(&cursor, line_end, &token);
+        if (token_len == 0) {
+            line = next_line;
+            continue;
+        }
 
-        if (strcmp(token, "DIM") == 0) {
-            char* h_str = strtok(NULL, " \t\r");
-            char* w_str = strtok(NULL, " \t\r");
-            if (w_str && h_str) {
-                board->height = atoi(h_str);
-                board->width = atoi(w_str);
-                
-                board->board = calloc(board->width * board->height, sizeof(board_pos_t));
+        if (token_is(token, token_len, "DIM")) {
+            const char *h_str, *w_str;
+            int h_len = next_token(&cursor, line_end, &h_str);
+            int w_len = next_token(&cursor, line_end, &w_str);
+            if (w_len && h_len) {
+                board->height = token_to_int(h_str, h_len);
+                board->width = token_to_int(w_str, w_len);
+                if (board->tiles != NULL || board->width <= 0 || board->height <= 0 || alloc_tiles(board) != 0) {
+                    map_cell_index = -1;
+                    break;
+                }
             }
         }
-        else if (strcmp(token, "TEMPO") == 0) {
-            char *t_str = strtok(NULL, " \t\r");
-            if (t_str) board->tempo = atoi(t_str);
+        else if (token_is(token, token_len, "TEMPO")) {
+            const char* t_str;
+            int t_len = next_token(&cursor, line_end, &t_str);
+            if (t_len) board->tempo_us = token_to_us(t_str, t_len);
         }
-        else if (strcmp(token, "PAC") == 0) {
-            char *p_file = strtok(NULL, " \t\r");
-            if (p_file) {
-                snprintf(board->pacman_file, MAX_FILENAME, "%s%s", board->assets_dir, p_file);
+        else if (token_is(token, token_len, "PAC")) {
+            const char* p_file;
+            int p_len = next_token(&cursor, line_end, &p_file);
+            if (p_len) {
+                snprintf(board->pacman_file, MAX_FILENAME, "%s%.*s", board->assets_dir, p_len, p_file);
             }
         }
-        else if (strcmp(token, "MON") == 0) {
-            char *m_file = strtok(NULL, " \t\r");
-            
-            while (m_file != NULL && board->n_ghosts < MAX_GHOSTS) {
-                snprintf(board->ghosts_files[board->n_ghosts], MAX_FILENAME, "%s%s", board->assets_dir, m_file);
-                board->n_ghosts++;
-                m_file = strtok(NULL, " \t\r");
-            }
-            
-            if (board->n_ghosts > 0) {
-                board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
+        else if (token_is(token, token_len, "MON")) {
+            if (add_ghost_files(board, cursor, line_end) != 0) {
+                map_cell_index = -1;
+                break;
             }
         }
-        else {
+        else if (board->tiles != NULL) {
             // --- Map Data Processing ---
-            if (board->board != NULL) {
-                int len = strlen(line_buffer);
-                for (int i = 0; i < len; i++) {
-                    char c = line_buffer[i];
-                    
-                    // Stop if we filled the board
-                    if (map_cell_index >= board->width * board->height) break;
-
-                    // Map characters to board_pos_t
-                    if (c == 'X' || c == 'o' || c == '@') {
-                        board_pos_t *pos = &board->board[map_cell_index];
-                        
-                        pos->has_dot = 0; 
-                        pos->has_portal = 0;
-                        pos->content = ' '; 
-
-                        if (c == 'X') {
-                            pos->content = 'W';
-                        } 
-                        else if (c == '@') {
-                            pos->has_portal = 1;
-                            pos->content = ' '; 
-                        } 
-                        else if (c == 'o') {
-                            pos->has_dot = 1;
-                            pos->content = ' ';
-                        }
-                        
-                        map_cell_index++;
-                    }
-                }
-            }
+            map_cell_index = fill_map_row(board, line, (int)(line_end - line), map_cell_index);
+            if (map_cell_index < 0) break;
         }
+
+        line = next_line;
     }
 
-    close(fd);
+    munmap((void*)data, size);
+    board->load_stats.syscalls++;
     
-    if (board->board == NULL) {
-        perror("Error: Board dimensions not found or allocation failed.\n");
+    if (board->tiles == NULL || map_cell_index < 0) {
+        perror("Error: Board dimensions missing, repeated or invalid, or allocation failed.\n");
         return -1;
     }
 
+    // Only now is the number of ghosts known, the MON lines may come in any number
+    if (board->n_ghosts > 0) {
+        board->ghosts = arena_alloc(&board->arena, board->n_ghosts * sizeof(ghost_t));
+        if (board->ghosts == NULL) {
+            perror("Error: Could not allocate the ghosts.\n");
+            return -1;
+        }
+    }
+
+    // A map shorter than its dimensions leaves the last cells out of the level, they stay walls
     return 0;
 }
 
 
+// Moves of a script being parsed, copied into the level arena once the whole script is read
+typedef struct {
+    command_t* items;
+    int count;
+    int capacity;
+    int failed;                     // a move could not be added, the script is incomplete
+} move_list_t;
+
+// Appends the move starting with 'token', the rest of the line is still in strtok. Returns 0 on success,
+// -1 if out of memory.
+static int add_move(move_list_t* moves, const char* token) {
+    if (moves->count == moves->capacity) {
+        int capacity = moves->capacity > 0 ? moves->capacity * 2 : 16;
+        command_t* items = realloc(moves->items, capacity * sizeof(command_t));
+        if (items == NULL) {
+            moves->failed = 1;
+            return -1;
+        }
+        moves->items = items;
+        moves->capacity = capacity;
+    }
+
+    command_t* cmd = &moves->items[moves->count++];
+    cmd->command = token[0]; // 'A', 'W', 'S', etc.
+    cmd->turns = 0;
+    cmd->turns_left = 0;
+
+    // Handle 'T' (Wait) argument
+    if (cmd->command == 'T') {
+        char* arg = strtok(NULL, " \t\r\n");
+        if (arg) {
+            cmd->turns = atoi(arg);
+            cmd->turns_left = cmd->turns;
+        }
+    }
+    return 0;
+}
+
+// Moves the parsed moves into exactly sized room in the level arena. Returns 0 on success, -1 if out of memory.
+static int finish_moves(board_t* board, move_list_t* list, command_t** moves, int* n_moves) {
+    int failed = list->failed;
+    *moves = NULL;
+    *n_moves = 0;
+    if (!failed && list->count > 0) {
+        *moves = arena_alloc(&board->arena, list->count * sizeof(command_t));
+        if (*moves != NULL) {
+            memcpy(*moves, list->items, list->count * sizeof(command_t));
+            *n_moves = list->count;
+        } else {
+            failed = 1;
+        }
+    }
+    free(list->items);
+
+    if (failed) {
+        perror("Error: Could not allocate the moves of a script");
+        return -1;
+    }
+    return 0;
+}
+
 int parse_pacman_file(board_t* board) {
     const char* filepath = board->pacman_file;
     debug("Parsing pacman file: %s\n", filepath);
@@ -187,16 +374,19 @@ int parse_pacman_file(board_t* board) {
     }
 
     pacman_t* pacman = &board->pacmans[0];
+    move_list_t moves = {0};
 
-    char line_buffer[1024];
-    char line_work[1024];
+    line_reader_t reader;
+    reader_init(&reader, fd);
 
-    while (read_line(fd, line_buffer, 1024) > 0) {
-        if (strlen(line_buffer) == 0) continue;
-        if (line_buffer[0] == '#') continue;
+    char* line;
+    int len;
 
-        strcpy(line_work, line_buffer);
-        char* token = strtok(line_work, " \t\r\n");
+    while ((line = reader_next_line(&reader, &len)) != NULL) {
+        if (len == 0) continue;
+        if (line[0] == '#') continue;
+
+        char* token = strtok(line, " \t\r\n");
         if (token == NULL) continue;
 
         // --- DIRECTIVES ---
@@ -213,29 +403,14 @@ int parse_pacman_file(board_t* board) {
             }
         }
         // --- COMMANDS ---
-        else {
-            if (pacman->n_moves < MAX_MOVES) {
-                command_t* cmd = &pacman->moves[pacman->n_moves];
-                
-                cmd->command = token[0]; // 'A', 'W', 'S', etc.
-                cmd->turns = 0;
-                cmd->turns_left = 0;
-
-                // Handle 'T' (Wait) argument
-                if (cmd->command == 'T') {
-                    char* arg = strtok(NULL, " \t\r\n");
-                    if (arg) {
-                        cmd->turns = atoi(arg);
-                        cmd->turns_left = cmd->turns;
-                    }
-                }
-                pacman->n_moves++;
-            }
+        else if (add_move(&moves, token) != 0) {
+            break;
         }
     }
 
     close(fd);
-    return 0;
+    account_load(board, &reader);
+    return finish_moves(board, &moves, &pacman->moves, &pacman->n_moves);
 }
 
 
@@ -250,16 +425,19 @@ int parse_ghost_file(board_t* board, int ghost_idx) {
     }
 
     ghost_t* ghost = &board->ghosts[ghost_idx];
+    move_list_t moves = {0};
 
-    char line_buffer[1024];
-    char line_work[1024];
+    line_reader_t reader;
+    reader_init(&reader, fd);
 
-    while (read_line(fd, line_buffer, 1024) > 0) {
-        if (strlen(line_buffer) == 0) continue;
-        if (line_buffer[0] == '#') continue;
+    char* line;
+    int len;
 
-        strcpy(line_work, line_buffer);
-        char* token = strtok(line_work, " \t\r\n");
+    while ((line = reader_next_line(&reader, &len)) != NULL) {
+        if (len == 0) continue;
+        if (line[0] == '#') continue;
+
+        char* token = strtok(line, " \t\r\n");
         if (token == NULL) continue;
 
         // --- DIRECTIVES ---
@@ -276,27 +454,12 @@ int parse_ghost_file(board_t* board, int ghost_idx) {
             }
         }
         // --- COMMANDS ---
-        else {
-            if (ghost->n_moves < MAX_MOVES) {
-                command_t* cmd = &ghost->moves[ghost->n_moves];
-                
-                cmd->command = token[0]; // 'A', 'W', 'S', etc.
-                cmd->turns = 0;
-                cmd->turns_left = 0;
-
-                // Handle 'T' (Wait) argument
-                if (cmd->command == 'T') {
-                    char* arg = strtok(NULL, " \t\r\n");
-                    if (arg) {
-                        cmd->turns = atoi(arg);
-                        cmd->turns_left = cmd->turns;
-                    }
-                }
-                ghost->n_moves++;
-            }
+        else if (add_move(&moves, token) != 0) {
+            break;
         }
     }
 
     close(fd);
-    return 0;
+    account_load(board, &reader);
+    return finish_moves(board, &moves, &ghost->moves, &ghost->n_moves);
 }
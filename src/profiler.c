@@ -0,0 +1,87 @@
+#include "profiler.h"
+#include "histogram.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+static void on_sigusr1(int signal);
+
+static const char* phase_names[N_PHASES] = {
+    "frame wait", "release", "slowest entity", "join", "turn", "result", "input", "render",
+};
+
+static int enabled = 0;
+static histogram_t phases[N_PHASES];
+static long long thread_cpu_ns[PROF_MAX_THREADS];
+static int n_threads = 0;
+static volatile sig_atomic_t dump_requested = 0;
+
+
+void profiler_init() {
+    for (int i = 0; i < N_PHASES; i++) {
+        hist_reset(&phases[i]);
+    }
+    enabled = 1;
+
+    struct sigaction action;
+    action.sa_handler = on_sigusr1;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+int profiler_enabled() {
+    return enabled;
+}
+
+void prof_record(phase_t phase, long long ns) {
+    hist_record(&phases[phase], ns > 0 ? (uint64_t)ns : 0);
+}
+
+void prof_add_thread_cpu(int worker_id, long long ns) {
+    if (worker_id >= PROF_MAX_THREADS) worker_id = PROF_MAX_THREADS - 1;
+    thread_cpu_ns[worker_id] += ns;
+    if (worker_id >= n_threads) n_threads = worker_id + 1;
+}
+
+void prof_poll() {
+    if (!dump_requested) return;
+    dump_requested = 0;
+
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (out == NULL) return;
+    prof_report(out);
+    fclose(out);
+    debug("%s", text);
+    free(text);
+}
+
+void prof_report(FILE* out) {
+    if (!enabled) return;
+
+    fprintf(out, "=== PHASE PROFILE (%ld turns) ===\n", phases[PHASE_TURN].count);
+    fprintf(out, "%-16s %10s %10s %10s %10s\n", "phase", "p50 us", "p99 us", "max us", "mean us");
+    for (int i = 0; i < N_PHASES; i++) {
+        const histogram_t* hist = &phases[i];
+        if (hist->count == 0) continue;
+        fprintf(out, "%-16s %10.1f %10.1f %10.1f %10.1f\n", phase_names[i], hist_percentile(hist, 50) / 1e3,
+                hist_percentile(hist, 99) / 1e3, hist->max / 1e3, hist_mean(hist) / 1e3);
+    }
+
+    // The UI thread is still running, the workers are counted when they exit at the end of each level
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    fprintf(out, "CPU time: UI thread %.3f ms", (ts.tv_sec * 1e9 + ts.tv_nsec) / 1e6);
+    for (int i = 1; i < n_threads; i++) {
+        fprintf(out, ", worker %d %.3f ms", i, thread_cpu_ns[i] / 1e6);
+    }
+    fprintf(out, "\n");
+}
+
+static void on_sigusr1(int signal) {
+    (void)signal;
+    dump_requested = 1;
+}
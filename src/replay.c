@@ -0,0 +1,195 @@
+#include "replay.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+
+typedef struct {
+    long turn;
+    char key;
+} replay_event_t;
+
+static void write_event(long turn, char key);
+
+static FILE* record_file = NULL;
+static long record_last_turn = 0;
+
+static replay_event_t* events = NULL;   // whole replay, decoded when it is opened
+static int n_events = 0;
+static int next_event = 0;
+
+
+int record_open(const char* path, const game_options_t* opts) {
+    record_file = fopen(path, "wb");
+    if (record_file == NULL) {
+        debug("Error creating replay file %s\n", path);
+        return -1;
+    }
+
+    replay_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.seed = opts->seed;
+    header.engine = opts->engine;
+    header.backup = opts->backup;
+    header.journal_kb = (uint32_t)opts->journal_kb;
+
+    if (fwrite(&header, sizeof(header), 1, record_file) != 1) {
+        debug("Error writing replay file %s\n", path);
+        fclose(record_file);
+        record_file = NULL;
+        return -1;
+    }
+    record_last_turn = 0;
+    return 0;
+}
+
+void record_key(long turn, char key) {
+    if (key == '\0') return;
+    write_event(turn, key);
+}
+
+void record_resume(long turn) {
+    write_event(turn, REPLAY_RESUME);
+}
+
+void record_flush() {
+    if (record_file != NULL) fflush(record_file);
+}
+
+void record_close(long turn) {
+    if (record_file == NULL) return;
+    write_event(turn, REPLAY_END);
+    fclose(record_file);
+    record_file = NULL;
+}
+
+static void write_event(long turn, char key) {
+    if (record_file == NULL) return;
+
+    // Zigzag so the small negative steps of a resume stay one byte long
+    long delta = turn - record_last_turn;
+    unsigned long value = ((unsigned long)delta << 1) ^ (unsigned long)(delta >> (sizeof(long) * 8 - 1));
+    record_last_turn = turn;
+
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, record_file);
+        value >>= 7;
+    }
+    fputc((int)value, record_file);
+    fputc(key, record_file);
+}
+
+int replay_open(const char* path, game_options_t* opts) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open replay %s\n", path);
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // Headers before version 3 end before journal_kb
+    replay_header_t header;
+    size_t header_size = offsetof(replay_header_t, journal_kb);
+    memset(&header, 0, sizeof(header));
+    if (size < (long)header_size || fread(&header, header_size, 1, file) != 1 ||
+        memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 || header.version < 1 ||
+        header.version > REPLAY_VERSION) {
+        fprintf(stderr, "%s is not a replay file\n", path);
+        fclose(file);
+        return -1;
+    }
+    if (header.version >= 3) {
+        if (fread(&header.journal_kb, sizeof(header.journal_kb), 1, file) != 1) {
+            fprintf(stderr, "%s is not a replay file\n", path);
+            fclose(file);
+            return -1;
+        }
+        header_size = sizeof(header);
+        // Rewinding goes back as far as the journal of the recorded game did
+        opts->journal_kb = header.journal_kb;
+    }
+
+    size_t length = size - header_size;
+    unsigned char* data = malloc(length + 1);
+    // Every event takes at least two bytes
+    events = malloc((length / 2 + 1) * sizeof(replay_event_t));
+    if (data == NULL || events == NULL || fread(data, 1, length, file) != length) {
+        fprintf(stderr, "Error reading replay %s\n", path);
+        free(data);
+        replay_close();
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    long turn = 0;
+    size_t pos = 0;
+    n_events = 0;
+    while (pos < length) {
+        unsigned long value = 0;
+        int shift = 0;
+        while (pos < length && (data[pos] & 0x80)) {
+            value |= (unsigned long)(data[pos++] & 0x7F) << shift;
+            shift += 7;
+        }
+        if (pos + 1 >= length) break; // truncated event, the recording was interrupted
+        value |= (unsigned long)data[pos++] << shift;
+
+        turn += (long)(value >> 1) ^ -(long)(value & 1);
+        events[n_events].turn = turn;
+        events[n_events].key = (char)data[pos++];
+        n_events++;
+    }
+    free(data);
+
+    next_event = 0;
+    opts->seed = header.seed;
+    opts->has_seed = 1;
+    // A quicksave resumes differently in each mode, the game must take the same path it was recorded on
+    opts->backup = header.version == 1 ? BACKUP_FORK : header.backup;
+    if (header.engine != (uint32_t)opts->engine) {
+        debug("Replay was recorded with the %s engine\n", header.engine == ENGINE_SERIAL ? "serial" : "pool");
+    }
+    debug("Loaded replay %s: %d events, seed %u\n", path, n_events, header.seed);
+    return 0;
+}
+
+char replay_key(long turn) {
+    // Events of turns this game did not sample means it went a different way than the recorded one
+    while (next_event < n_events && events[next_event].turn < turn &&
+           events[next_event].key != REPLAY_END && events[next_event].key != REPLAY_RESUME) {
+        debug("Replay diverged: key %c of turn %ld was not used\n", events[next_event].key, events[next_event].turn);
+        next_event++;
+    }
+
+    if (next_event < n_events && events[next_event].turn == turn &&
+        events[next_event].key != REPLAY_END && events[next_event].key != REPLAY_RESUME) {
+        return events[next_event++].key;
+    }
+    return '\0';
+}
+
+int replay_ended(long turn) {
+    return next_event < n_events && events[next_event].key == REPLAY_END && events[next_event].turn <= turn;
+}
+
+void replay_resume() {
+    while (next_event < n_events && events[next_event].key != REPLAY_RESUME) {
+        next_event++;
+    }
+    if (next_event < n_events) next_event++;
+}
+
+void replay_close() {
+    free(events);
+    events = NULL;
+    n_events = 0;
+    next_event = 0;
+}
@@ -0,0 +1,210 @@
+#include "snapshot.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct {
+    unsigned char* arena;           // snapshot_header_t followed by the level state, NULL if never used
+    size_t size;                    // bytes of the current snapshot, 0 if the slot is empty
+    size_t capacity;
+    long sequence;                  // order of the saves, to find the latest one
+} snapshot_slot_t;
+
+static snapshot_slot_t slots[SNAPSHOT_SLOTS];
+static int selected = 0;
+static long saves = 0;
+
+
+// Helper private function putting back the countdowns of a script: only move 'current_move' was counting
+// down when the snapshot was taken, the others had been reset to their full wait
+static void restore_moves(command_t* moves, int n_moves, int current_move, int32_t turns_left) {
+    if (n_moves == 0) return;
+    for (int i = 0; i < n_moves; i++) {
+        moves[i].turns_left = moves[i].turns;
+    }
+    moves[current_move % n_moves].turns_left = turns_left;
+}
+
+// Helper private function filling the fields pacmans and ghosts share
+static void encode_entity(snapshot_entity_t* out, int pos_x, int pos_y, const rng_t* rng, const command_t* moves,
+                          int n_moves, int current_move, int waiting) {
+    memset(out, 0, sizeof(*out));
+    out->pos_x = pos_x;
+    out->pos_y = pos_y;
+    out->n_moves = n_moves;
+    out->current_move = current_move;
+    out->waiting = waiting;
+    out->turns_left = n_moves > 0 ? moves[current_move % n_moves].turns_left : 0;
+    memcpy(out->rng, rng->s, sizeof(out->rng));
+}
+
+// Helper private function checking a saved entity against the level it is restored into: the same script,
+// so its countdowns fit in the moves of the level arena, and a cell of an allocated tile
+static int entity_fits(const board_t* board, const snapshot_entity_t* entity, int loaded_moves) {
+    if (entity->n_moves != loaded_moves || entity->current_move < 0) return 0;
+    if (entity->pos_x < 0 || entity->pos_x >= board->width || entity->pos_y < 0 || entity->pos_y >= board->height) {
+        return 0;
+    }
+    return cell_tile(board, cell_index(board, entity->pos_x, entity->pos_y)) != NULL;
+}
+
+void snapshot_select(int slot) {
+    if (slot >= 0 && slot < SNAPSHOT_SLOTS) selected = slot;
+}
+
+int snapshot_selected() {
+    return selected;
+}
+
+size_t snapshot_size(const board_t* board) {
+    size_t dot_words = (size_t)board->n_tiles * TILE_SIZE;
+    return sizeof(snapshot_header_t) + dot_words * sizeof(uint64_t) +
+           (board->n_pacmans + board->n_ghosts) * sizeof(snapshot_entity_t);
+}
+
+void snapshot_encode(const board_t* board, void* buffer) {
+    snapshot_header_t* header = (snapshot_header_t*)buffer;
+    memset(header, 0, sizeof(*header));
+    header->level = board->current_level;
+    header->width = board->width;
+    header->height = board->height;
+    header->n_pacmans = board->n_pacmans;
+    header->n_ghosts = board->n_ghosts;
+    header->n_tiles = board->n_tiles;
+    header->total_turns = board->total_turns;
+
+    uint64_t* dots = (uint64_t*)(header + 1);
+    for (long t = 0; t < board->n_tiles; t++, dots += TILE_SIZE) {
+        memcpy(dots, board->tile_list[t]->planes[PLANE_DOTS], TILE_SIZE * sizeof(uint64_t));
+    }
+
+    snapshot_entity_t* entities = (snapshot_entity_t*)dots;
+    for (int i = 0; i < board->n_pacmans; i++) {
+        const pacman_t* pacman = &board->pacmans[i];
+        snapshot_entity_t* entity = entities++;
+        encode_entity(entity, pacman->pos_x, pacman->pos_y, &pacman->rng, pacman->moves, pacman->n_moves,
+                      pacman->current_move, pacman->waiting);
+        entity->points = pacman->points;
+        entity->alive = atomic_load(&pacman->alive);
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        const ghost_t* ghost = &board->ghosts[i];
+        snapshot_entity_t* entity = entities++;
+        encode_entity(entity, ghost->pos_x, ghost->pos_y, &ghost->rng, ghost->moves, ghost->n_moves,
+                      ghost->current_move, ghost->waiting);
+        entity->charged = ghost->charged;
+    }
+}
+
+int snapshot_decode(board_t* board, const void* buffer, size_t size) {
+    const snapshot_header_t* header = (const snapshot_header_t*)buffer;
+    if (size < sizeof(snapshot_header_t) || header->level != board->current_level ||
+        header->width != board->width || header->height != board->height ||
+        header->n_pacmans != board->n_pacmans || header->n_ghosts != board->n_ghosts ||
+        header->n_tiles != board->n_tiles || size != snapshot_size(board)) {
+        return -1;
+    }
+
+    size_t dot_words = (size_t)board->n_tiles * TILE_SIZE;
+    const uint64_t* dots = (const uint64_t*)(header + 1);
+    const snapshot_entity_t* pacmans = (const snapshot_entity_t*)(dots + dot_words);
+    const snapshot_entity_t* ghosts = pacmans + board->n_pacmans;
+
+    // Nothing is restored unless every entity fits the level, a snapshot of another script or a corrupt
+    // autosave would write past the moves or index cells outside the board
+    for (int i = 0; i < board->n_pacmans; i++) {
+        if (!entity_fits(board, &pacmans[i], board->pacmans[i].n_moves)) return -1;
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        if (!entity_fits(board, &ghosts[i], board->ghosts[i].n_moves)) return -1;
+    }
+
+    restore_dots(board, dots);
+    for (int i = 0; i < board->n_pacmans; i++) {
+        pacman_t* pacman = &board->pacmans[i];
+        const snapshot_entity_t* entity = &pacmans[i];
+        pacman->pos_x = entity->pos_x;
+        pacman->pos_y = entity->pos_y;
+        pacman->points = entity->points;
+        atomic_store(&pacman->alive, entity->alive);
+        pacman->current_move = entity->current_move;
+        pacman->waiting = entity->waiting;
+        memcpy(pacman->rng.s, entity->rng, sizeof(pacman->rng.s));
+        restore_moves(pacman->moves, pacman->n_moves, pacman->current_move, entity->turns_left);
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        const snapshot_entity_t* entity = &ghosts[i];
+        ghost->pos_x = entity->pos_x;
+        ghost->pos_y = entity->pos_y;
+        ghost->charged = entity->charged;
+        ghost->current_move = entity->current_move;
+        ghost->waiting = entity->waiting;
+        memcpy(ghost->rng.s, entity->rng, sizeof(ghost->rng.s));
+        restore_moves(ghost->moves, ghost->n_moves, ghost->current_move, entity->turns_left);
+    }
+
+    rebuild_occupancy(board);
+    return 0;
+}
+
+int snapshot_save(const board_t* board) {
+    long long start_ns = monotonic_ns();
+    snapshot_slot_t* slot = &slots[selected];
+    size_t size = snapshot_size(board);
+
+    if (size > slot->capacity) {
+        unsigned char* arena = realloc(slot->arena, size);
+        if (arena == NULL) {
+            debug("Snapshot slot %d: cannot allocate %zu bytes\n", selected + 1, size);
+            return -1;
+        }
+        slot->arena = arena;
+        slot->capacity = size;
+    }
+    snapshot_encode(board, slot->arena);
+
+    slot->size = size;
+    slot->sequence = ++saves;
+    debug("Snapshot slot %d: saved turn %ld in %.3f ms, %zu bytes\n", selected + 1, board->total_turns,
+          (monotonic_ns() - start_ns) / 1e6, size);
+    return 0;
+}
+
+int snapshot_restore(board_t* board, int slot_id) {
+    long long start_ns = monotonic_ns();
+    snapshot_slot_t* slot = &slots[slot_id];
+
+    if (slot->size == 0 || snapshot_decode(board, slot->arena, slot->size) != 0) {
+        debug("Snapshot slot %d: nothing saved in this level\n", slot_id + 1);
+        return -1;
+    }
+
+    debug("Snapshot slot %d: restored turn %ld in %.3f ms\n", slot_id + 1,
+          (long)((const snapshot_header_t*)slot->arena)->total_turns, (monotonic_ns() - start_ns) / 1e6);
+    return 0;
+}
+
+int snapshot_latest(const board_t* board) {
+    int latest = -1;
+    for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+        const snapshot_header_t* header = (const snapshot_header_t*)slots[i].arena;
+        if (slots[i].size == 0 || header->level != board->current_level) continue;
+        if (latest < 0 || slots[i].sequence > slots[latest].sequence) latest = i;
+    }
+    return latest;
+}
+
+void snapshot_drop(int slot) {
+    slots[slot].size = 0;
+}
+
+void snapshot_free() {
+    for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+        free(slots[i].arena);
+        slots[i].arena = NULL;
+        slots[i].size = 0;
+        slots[i].capacity = 0;
+    }
+}
@@ -1,33 +1,69 @@
 #include "board.h"
 #include "utils.h"
 #include <unistd.h>
-#include <stdio.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 
-FILE * debugfile;
+#define MAX_LISTED_GHOSTS 16        // ghost files print_board lists
 
-int read_line(int fd, char *buffer, int max_len) {
-    int n_read = 0;
-    char c;
-    int status;
 
-    while (n_read < max_len - 1) {
-        status = read(fd, &c, 1);
-        
-        if (status == 0) {
-            if (n_read == 0) return 0; 
-            break;
+void reader_init(line_reader_t* reader, int fd) {
+    reader->fd = fd;
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = 0;
+    reader->error = 0;
+    reader->n_syscalls = 0;
+    reader->n_bytes = 0;
+}
+
+char* reader_next_line(line_reader_t* reader, int* len) {
+    int scanned = reader->start;
+
+    while (1) {
+        char* newline = memchr(reader->buffer + scanned, '\n', reader->end - scanned);
+        if (newline != NULL) {
+            char* line = reader->buffer + reader->start;
+            *newline = '\0';
+            *len = (int)(newline - line);
+            reader->start = (int)(newline - reader->buffer) + 1;
+            return line;
         }
-        if (status < 0) return -1;
 
-        if (c == '\n') break;
+        int pending = reader->end - reader->start;
+        if (reader->eof || reader->error || pending == READER_BLOCK_SIZE) {
+            // Last line without '\n', or a line that does not fit in the buffer
+            if (pending == 0) return NULL;
+            char* line = reader->buffer + reader->start;
+            line[pending] = '\0';
+            *len = pending;
+            reader->start = reader->end;
+            return line;
+        }
 
-        buffer[n_read++] = c;
+        // Move the partial line to the front and fill the rest of the block
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, pending);
+            reader->start = 0;
+            reader->end = pending;
+        }
+        scanned = reader->end;
+
+        ssize_t n = read(reader->fd, reader->buffer + reader->end, READER_BLOCK_SIZE - reader->end);
+        reader->n_syscalls++;
+        if (n < 0) {
+            reader->error = 1;
+        } else if (n == 0) {
+            reader->eof = 1;
+        } else {
+            reader->end += (int)n;
+            reader->n_bytes += n;
+        }
     }
-    buffer[n_read] = '\0';
-    return n_read;
 }
 
 void sleep_ms(int milliseconds) {
@@ -37,25 +73,24 @@ void sleep_ms(int milliseconds) {
     nanosleep(&ts, NULL);
 }
 
-void open_debug_file(char *filename) {
-    debugfile = fopen(filename, "w");
-}
-
-void close_debug_file() {
-    fclose(debugfile);
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-void debug(const char * format, ...) {
+// Helper private function appending to 'buffer' of 'size' bytes at '*offset', what does not fit is cut
+static void append(char* buffer, size_t size, size_t* offset, const char* format, ...) {
+    if (*offset >= size - 1) return;
     va_list args;
     va_start(args, format);
-    vfprintf(debugfile, format, args);
+    int written = vsnprintf(buffer + *offset, size - *offset, format, args);
     va_end(args);
-
-    fflush(debugfile);
+    if (written > 0) *offset += (size_t)written < size - 1 - *offset ? (size_t)written : size - 1 - *offset;
 }
 
 void print_board(board_t *board) {
-    if (!board || !board->board) {
+    if (!board || !board->tiles) {
         debug("[%d] Board is empty or not initialized.\n", getpid());
         return;
     }
@@ -64,36 +99,44 @@ void print_board(board_t *board) {
     char buffer[8192];
     size_t offset = 0;
 
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                       "=== [%d] LEVEL INFO ===\n"
-                       "Dimensions: %d x %d\n"
-                       "Tempo: %d\n"
-                       "Pacman file: %s\n",
-                       getpid(), board->height, board->width, board->tempo, board->pacman_file);
-
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                       "Monster files (%d):\n", board->n_ghosts);
-
-    for (int i = 0; i < board->n_ghosts; i++) {
-        offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                           "  - %s\n", board->ghosts_files[i]);
+    append(buffer, sizeof(buffer), &offset,
+           "=== [%d] LEVEL INFO ===\n"
+           "Dimensions: %d x %d\n"
+           "Dots left: %ld\n"
+           "Tempo: %.3f ms\n"
+           "Pacman file: %s\n",
+           getpid(), board->height, board->width, count_dots(board), board->tempo_us / 1000.0,
+           board->pacman_file);
+
+    append(buffer, sizeof(buffer), &offset, "Monster files (%d):\n", board->n_ghosts);
+
+    // A level may have thousands of ghosts, only the first ones are listed
+    int listed = board->n_ghosts < MAX_LISTED_GHOSTS ? board->n_ghosts : MAX_LISTED_GHOSTS;
+    for (int i = 0; i < listed; i++) {
+        append(buffer, sizeof(buffer), &offset, "  - %s\n", board->ghosts_files[i]);
+    }
+    if (listed < board->n_ghosts) {
+        append(buffer, sizeof(buffer), &offset, "  ... and %d more\n", board->n_ghosts - listed);
     }
 
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n=== BOARD ===\n");
-
-    for (int y = 0; y < board->height; y++) {
-        for (int x = 0; x < board->width; x++) {
-            int idx = y * board->width + x;
-            if (offset < sizeof(buffer) - 2) {
-                buffer[offset++] = board->board[idx].content;
-            }
-        }
+    append(buffer, sizeof(buffer), &offset, "\n=== BOARD ===\n");
+
+    // board_row fills whole tiles, and the rows past the end of the buffer are not even built
+    char* row = malloc((size_t)board->tiles_x * TILE_SIZE);
+    if (row == NULL) append(buffer, sizeof(buffer), &offset, "(cannot allocate a row to print)\n");
+    for (int y = 0; row != NULL && y < board->height && offset < sizeof(buffer) - 2; y++) {
+        board_row(board, y, row);
+        size_t room = offset < sizeof(buffer) - 2 ? sizeof(buffer) - 2 - offset : 0;
+        size_t n = (size_t)board->width < room ? (size_t)board->width : room;
+        memcpy(buffer + offset, row, n);
+        offset += n;
         if (offset < sizeof(buffer) - 2) {
             buffer[offset++] = '\n';
         }
     }
+    free(row);
 
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset, "==================\n");
+    append(buffer, sizeof(buffer), &offset, "==================\n");
 
     buffer[offset] = '\0';
 
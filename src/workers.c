@@ -0,0 +1,216 @@
+#include "workers.h"
+#include "board.h"
+#include "utils.h"
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+
+static void* worker_thread(void* arg);
+static void stop_started(worker_pool_t* pool, int started);
+static void play_share(worker_pool_t* pool, int worker_id);
+
+
+void barrier_init(barrier_t* barrier, int n_threads) {
+    atomic_init(&barrier->count, n_threads);
+    atomic_init(&barrier->sense, 0);
+    barrier->n_threads = n_threads;
+    pthread_mutex_init(&barrier->mutex, NULL);
+    pthread_cond_init(&barrier->cond, NULL);
+}
+
+void barrier_destroy(barrier_t* barrier) {
+    pthread_mutex_destroy(&barrier->mutex);
+    pthread_cond_destroy(&barrier->cond);
+}
+
+void barrier_wait(barrier_t* barrier, int* local_sense) {
+    int sense = !*local_sense;
+    *local_sense = sense;
+
+    if (atomic_fetch_sub(&barrier->count, 1) == 1) {
+        // Last one to arrive: rearm the barrier and release everyone
+        atomic_store(&barrier->count, barrier->n_threads);
+        pthread_mutex_lock(&barrier->mutex);
+        atomic_store(&barrier->sense, sense);
+        pthread_cond_broadcast(&barrier->cond);
+        pthread_mutex_unlock(&barrier->mutex);
+        return;
+    }
+
+    for (int i = 0; i < BARRIER_SPINS; i++) {
+        if (atomic_load_explicit(&barrier->sense, memory_order_acquire) == sense) return;
+        if ((i & 63) == 63) sched_yield();
+    }
+
+    pthread_mutex_lock(&barrier->mutex);
+    while (atomic_load(&barrier->sense) != sense) {
+        pthread_cond_wait(&barrier->cond, &barrier->mutex);
+    }
+    pthread_mutex_unlock(&barrier->mutex);
+}
+
+int pool_size(int requested, int n_entities) {
+    int n = requested;
+    if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > n_entities) n = n_entities;
+    if (n < 1) n = 1;
+    return n;
+}
+
+int pool_start(worker_pool_t* pool, board_t* board, int n_workers) {
+    pool->board = board;
+    pool->n_workers = n_workers;
+    pool->stop = 0;
+    pool->profile = board->opts->profile;
+    pool->workers = calloc(n_workers, sizeof(worker_t));
+    pool->queues = aligned_alloc(CACHE_LINE, n_workers * sizeof(work_queue_t));
+    if (pool->workers == NULL || pool->queues == NULL) {
+        free(pool->workers);
+        free(pool->queues);
+        return -1;
+    }
+    memset(pool->queues, 0, n_workers * sizeof(work_queue_t));
+
+    for (int i = 0; i < n_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+    }
+
+    if (pool_restart_after_fork(pool) != 0) {
+        pool_stop(pool);
+        return -1;
+    }
+    return 0;
+}
+
+int pool_restart_after_fork(worker_pool_t* pool) {
+    // The barrier may have been copied in the middle of a phase, start over from a clean one
+    barrier_init(&pool->barrier, pool->n_workers);
+
+    for (int i = 0; i < pool->n_workers; i++) {
+        pool->workers[i].sense = 0;
+    }
+
+    for (int i = 1; i < pool->n_workers; i++) {
+        if (pthread_create(&pool->workers[i].tid, NULL, worker_thread, &pool->workers[i]) != 0) {
+            debug("Error creating worker thread %d.\n", i);
+            stop_started(pool, i);
+            return -1;
+        }
+    }
+
+    debug("Worker pool started with %d workers.\n", pool->n_workers);
+    return 0;
+}
+
+void pool_run_turn(worker_pool_t* pool) {
+    board_t* board = pool->board;
+    int n_entities = board->n_pacmans + board->n_ghosts;
+
+    // Deal the entities in contiguous ranges, idle workers steal what is left of the others
+    for (int i = 0; i < pool->n_workers; i++) {
+        atomic_store_explicit(&pool->queues[i].next, n_entities * i / pool->n_workers, memory_order_relaxed);
+        pool->queues[i].end = n_entities * (i + 1) / pool->n_workers;
+    }
+
+    worker_t* self = &pool->workers[0];
+    long long mark = pool->profile ? monotonic_ns() : 0;
+    barrier_wait(&pool->barrier, &self->sense);
+    prof_lap(&mark, PHASE_RELEASE);
+    play_share(pool, 0);
+    mark = pool->profile ? monotonic_ns() : 0;
+    barrier_wait(&pool->barrier, &self->sense);
+    prof_lap(&mark, PHASE_JOIN);
+
+    if (pool->profile) {
+        long long slowest_ns = 0;
+        for (int i = 0; i < pool->n_workers; i++) {
+            if (pool->workers[i].slowest_ns > slowest_ns) slowest_ns = pool->workers[i].slowest_ns;
+            pool->workers[i].slowest_ns = 0;
+        }
+        prof_record(PHASE_SLOWEST_ENTITY, slowest_ns);
+    }
+}
+
+void pool_stop(worker_pool_t* pool) {
+    pool->stop = 1;
+    barrier_wait(&pool->barrier, &pool->workers[0].sense);
+
+    for (int i = 1; i < pool->n_workers; i++) {
+        pthread_join(pool->workers[i].tid, NULL);
+        if (pool->profile) prof_add_thread_cpu(i, pool->workers[i].cpu_ns);
+    }
+
+    barrier_destroy(&pool->barrier);
+    free(pool->workers);
+    free(pool->queues);
+}
+
+// Helper private function making the first 'started' workers exit when the others could not be created,
+// leaving a pool of the calling thread alone that pool_run_turn and pool_stop still work on
+static void stop_started(worker_pool_t* pool, int started) {
+    // They wait on a barrier sized for every worker, the missing ones are counted as arrived
+    pool->stop = 1;
+    pool->barrier.n_threads = started;
+    atomic_fetch_sub(&pool->barrier.count, pool->n_workers - started);
+    barrier_wait(&pool->barrier, &pool->workers[0].sense);
+    for (int i = 1; i < started; i++) {
+        pthread_join(pool->workers[i].tid, NULL);
+    }
+
+    barrier_destroy(&pool->barrier);
+    barrier_init(&pool->barrier, 1);
+    pool->workers[0].sense = 0;
+    pool->n_workers = 1;
+    pool->stop = 0;
+}
+
+static void* worker_thread(void* arg) {
+    worker_t* self = (worker_t*)arg;
+    worker_pool_t* pool = self->pool;
+
+    debug("Worker %d thread started.\n", self->id);
+
+    while (1) {
+        barrier_wait(&pool->barrier, &self->sense);
+        if (pool->stop) break;
+
+        play_share(pool, self->id);
+        barrier_wait(&pool->barrier, &self->sense);
+    }
+
+    if (pool->profile) {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        self->cpu_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+    return NULL;
+}
+
+// Plays the entities of the worker's own queue, then steals from the other queues
+static void play_share(worker_pool_t* pool, int worker_id) {
+    board_t* board = pool->board;
+    worker_t* self = &pool->workers[worker_id];
+
+    for (int k = 0; k < pool->n_workers; k++) {
+        work_queue_t* queue = &pool->queues[(worker_id + k) % pool->n_workers];
+
+        while (atomic_load_explicit(&queue->next, memory_order_relaxed) < queue->end) {
+            int entity = atomic_fetch_add_explicit(&queue->next, 1, memory_order_relaxed);
+            if (entity >= queue->end) break;
+
+            if (pool->profile) {
+                long long start_ns = monotonic_ns();
+                entity_play(board, entity);
+                long long took_ns = monotonic_ns() - start_ns;
+                if (took_ns > self->slowest_ns) self->slowest_ns = took_ns;
+            } else {
+                entity_play(board, entity);
+            }
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#!/bin/sh
+# Headless checks of the example levels: every engine and locking mode, the bundle, record and replay,
+# autosave resume and rewind must end on the same board. A few interactive runs go through the frame clock
+# when `script` can give the game a terminal. Run from the repository root with `make check`.
+
+GAME=./bin/Pacmanist
+BUNDLER=./bin/pacbundle
+LEVELS=tests/levels_example_1/
+
+# Final board hash of `-s 7 -n 20000` on the example levels, update it only when a change is meant to
+# alter how the game plays
+GOLDEN=49d08d902547242b
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+failures=0
+
+# Line "$1: ..." of the summary printed by a headless run of the game with the other arguments
+summary() {
+    pattern=$1
+    shift
+    "$GAME" "$@" 2>&1 | grep "^$pattern:" || echo "$pattern: <the game failed>"
+}
+
+expect() {
+    name=$1 expected=$2 got=$3
+    if [ "$got" = "$expected" ]; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name: expected '$expected', got '$got'"
+        failures=$((failures + 1))
+    fi
+}
+
+differ() {
+    name=$1 other=$2 got=$3
+    if [ "$got" != "$other" ]; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name: '$got' should differ"
+        failures=$((failures + 1))
+    fi
+}
+
+# Writes a replay of seed $2 with the events "turn:KEY ..." of $3 that ends at turn $4, the layout of replay.h
+replay() {
+    byte() { printf "\\$(printf %03o "$1")"; }
+    {
+        printf 'PACRPLY\0'; byte 3; byte 0; byte 0; byte 0
+        byte "$2"; byte 0; byte 0; byte 0
+        byte 0; byte 0; byte 0; byte 0          # engine pool
+        byte 0; byte 0; byte 0; byte 0          # quicksave snapshot
+        byte 0; byte 4; byte 0; byte 0          # 1024 KiB of journal
+        last=0
+        for event in $3; do
+            turn=${event%%:*}
+            byte $(((turn - last) * 2)); printf %s "${event#*:}"    # zigzag delta under 64, a single byte
+            last=$turn
+        done
+        byte $((($4 - last) * 2)); byte 0
+    } > "$1"
+}
+
+
+echo "== Engines and locking modes"
+hash="Final board hash: $GOLDEN"
+for mode in "-e serial" "-e pool -l rwlock" "-l cas" "-l stripe" "-l rwlock -C" "-j 1" "-j 3 -l cas" "-j 4 -l stripe"; do
+    expect "$mode" "$hash" "$(summary "Final board hash" -H -s 7 -n 20000 $mode $LEVELS)"
+done
+
+# A ghost waits on the portal the pacman walks into: the portal wins in every locking mode
+mkdir "$WORK/portal"
+printf 'DIM 3 5\nTEMPO 10\nPAC 1.p\nMON 1.m\nXXXXX\nXo@oX\nXXXXX\n' > "$WORK/portal/1.lvl"
+printf 'PASSO 0\nPOS 1 1\nD\n' > "$WORK/portal/1.p"
+printf 'PASSO 0\nPOS 1 2\nT 1000\n' > "$WORK/portal/1.m"
+expect "ghost on a portal -e serial" "Result: won" "$(summary "Result" -H -s 7 -n 50 -e serial "$WORK/portal/")"
+for field in "Result" "Final board hash"; do
+    serial=$(summary "$field" -H -s 7 -n 50 -e serial "$WORK/portal/")
+    for mode in "-l rwlock" "-l cas" "-l stripe"; do
+        expect "ghost on a portal $mode $field" "$serial" "$(summary "$field" -H -s 7 -n 50 $mode "$WORK/portal/")"
+    done
+done
+
+echo "== Bundle"
+if "$BUNDLER" $LEVELS "$WORK/levels.pbd" > /dev/null; then
+    for mode in "-e serial" "-l cas"; do
+        expect "bundle $mode" "$hash" "$(summary "Final board hash" -H -s 7 -n 20000 $mode "$WORK/levels.pbd")"
+    done
+else
+    expect "pacbundle" "compiled" "failed"
+fi
+
+echo "== Record and replay"
+for field in "Final board hash" "Points" "Turns"; do
+    recorded=$(summary "$field" -H -s 11 -n 3000 -r "$WORK/game.rpl" $LEVELS)
+    expect "replay $field" "$recorded" "$(summary "$field" -R "$WORK/game.rpl" $LEVELS)"
+done
+
+# The pacman of 1.p has no moves, the keys of the replay drive it
+printf 'PASSO 0\nPOS 1 1\n' > "$WORK/keys.p"
+KEYS="5:D 10:D 15:D 20:S 25:S 30:S 35:D 40:D 45:S 50:S 55:D 60:D 65:S 70:D 75:D 80:S 85:D 90:S 95:D"
+replay "$WORK/keys.rpl" 7 "$KEYS" 100
+keyed=$(summary "Final board hash" -R "$WORK/keys.rpl" -p "$WORK/keys.p" $LEVELS)
+for mode in "-e serial" "-l cas" "-l stripe"; do
+    expect "keyed replay $mode" "$keyed" "$(summary "Final board hash" -R "$WORK/keys.rpl" -p "$WORK/keys.p" $mode $LEVELS)"
+done
+
+echo "== Autosave resume"
+straight=$(summary "Final board hash" -H -s 7 -n 600 $LEVELS)
+summary "Final board hash" -H -s 7 -n 300 -A "$WORK/game.sav" $LEVELS > /dev/null
+expect "autosave written" "yes" "$([ -s "$WORK/game.sav" ] && echo yes || echo no)"
+expect "resume from the autosave" "$straight" "$(summary "Final board hash" -H -s 7 -n 600 -A "$WORK/game.sav" -c $LEVELS)"
+
+echo "== Rewind"
+# Z after turn 100 takes the game back 50 turns, where the same keys stopped at turn 50 left it
+replay "$WORK/rewind.rpl" 7 "$KEYS 100:Z" 100
+replay "$WORK/half.rpl" 7 "5:D 10:D 15:D 20:S 25:S 30:S 35:D 40:D 45:S 50:S" 50
+half=$(summary "Final board hash" -R "$WORK/half.rpl" -p "$WORK/keys.p" $LEVELS)
+for mode in "-e serial" "-l rwlock" "-l cas"; do
+    expect "rewind $mode" "$half" "$(summary "Final board hash" -R "$WORK/rewind.rpl" -p "$WORK/keys.p" $mode $LEVELS)"
+done
+differ "rewind moved the game" "$keyed" "$half"
+
+echo "== Interactive"
+# Only the interactive game waits on the frame clock, TEMPO 0 and a tempo that rounds to 0 us must not stop it
+if command -v script > /dev/null; then
+    for tempo in 0 0.0004; do
+        mkdir "$WORK/tempo_$tempo"
+        for file in $LEVELS*; do
+            sed "s/^TEMPO .*/TEMPO $tempo/" "$file" > "$WORK/tempo_$tempo/${file##*/}"
+        done
+        (sleep 1; printf q) | TERM=xterm timeout 20 script -qec "$GAME -s 7 $WORK/tempo_$tempo/" /dev/null > /dev/null
+        expect "TEMPO $tempo" "exit 0" "exit $?"
+    done
+else
+    echo "skip no script command to run the game in a terminal"
+fi
+
+echo
+if [ $failures -gt 0 ]; then
+    echo "$failures checks failed"
+    exit 1
+fi
+echo "All checks passed"
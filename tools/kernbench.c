@@ -0,0 +1,213 @@
+#include "kernels.h"
+#include "rng.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define DEFAULT_WIDTH 4096
+#define DEFAULT_HEIGHT 4096
+#define DEFAULT_ROUNDS 5
+#define DIFF_EVERY 4096     // one word in this many differs between the two dot planes
+
+typedef struct {
+    int width, height, stride;
+    size_t n_words;
+    uint64_t* walls;
+    uint64_t* portals;
+    uint64_t* dots;
+    uint64_t* saved_dots;   // the dots of another state of the board, for the diff
+    char* chars;            // every row expanded, width * height
+} planes_t;
+
+// Results of one pass of every operation, they must match between the kernels
+typedef struct {
+    size_t dots;
+    uint64_t chars;         // FNV-1a of the expanded rows
+    size_t diffs;
+} results_t;
+
+static const char glyphs[4] = {' ', '#', '@', '.'};
+
+static inline int test_bit(const uint64_t* plane, size_t bit) {
+    return (plane[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static inline void set_bit(uint64_t* plane, size_t bit) {
+    plane[bit >> 6] |= 1ULL << (bit & 63);
+}
+
+static void fill_planes(planes_t* planes, int width, int height);
+static void run_cells(const planes_t* planes, results_t* results, long long ns[3]);
+static void run_kernels(const planes_t* planes, results_t* results, long long ns[3]);
+static void run_best(void (*run)(const planes_t*, results_t*, long long[3]), const planes_t* planes, int rounds,
+                     results_t* results, long long best[3]);
+static uint64_t hash_chars(const planes_t* planes);
+
+
+int main(int argc, char** argv) {
+    if (argc > 4) {
+        fprintf(stderr, "Usage: %s [width] [height] [rounds]\n", argv[0]);
+        exit(1);
+    }
+    int width = argc > 1 ? atoi(argv[1]) : DEFAULT_WIDTH;
+    int height = argc > 2 ? atoi(argv[2]) : DEFAULT_HEIGHT;
+    int rounds = argc > 3 ? atoi(argv[3]) : DEFAULT_ROUNDS;
+    if (width < 1 || height < 1 || rounds < 1) {
+        fprintf(stderr, "Width, height and rounds must be positive\n");
+        exit(1);
+    }
+
+    planes_t planes;
+    fill_planes(&planes, width, height);
+    double n_cells = (double)width * height;
+    printf("Board of %d x %d cells, best of %d rounds\n", width, height, rounds);
+    printf("%-8s %14s %14s %14s %8s\n", "kernels", "count ns/cell", "expand ns/cell", "diff ns/cell", "speedup");
+
+    // The cell by cell loops the board used before the kernels are the baseline
+    results_t expected;
+    long long best[3];
+    run_best(run_cells, &planes, rounds, &expected, best);
+    long long baseline = best[0] + best[1] + best[2];
+    printf("%-8s %14.3f %14.3f %14.3f %7.1fx\n", "cell", best[0] / n_cells, best[1] / n_cells, best[2] / n_cells, 1.0);
+
+    int failed = 0;
+    const char* isas[] = {"scalar", "sse2", "avx2"};
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+        if (kernels_use(isas[k]) != 0) {
+            printf("%-8s not supported here\n", isas[k]);
+            continue;
+        }
+
+        results_t results;
+        run_best(run_kernels, &planes, rounds, &results, best);
+        printf("%-8s %14.3f %14.3f %14.3f %7.1fx\n", isas[k], best[0] / n_cells, best[1] / n_cells,
+               best[2] / n_cells, (double)baseline / (best[0] + best[1] + best[2]));
+        if (results.dots != expected.dots || results.chars != expected.chars || results.diffs != expected.diffs) {
+            printf("%-8s results differ from the cell loops\n", isas[k]);
+            failed = 1;
+        }
+    }
+
+    free(planes.walls);
+    free(planes.chars);
+    return failed;
+}
+
+// Random map: about a third of walls, dots in most of the rest and a few portals
+static void fill_planes(planes_t* planes, int width, int height) {
+    planes->width = width;
+    planes->height = height;
+    planes->stride = (width + 63) / 64;
+    planes->n_words = (size_t)height * planes->stride;
+    planes->walls = calloc(4 * planes->n_words, sizeof(uint64_t));
+    planes->chars = malloc((size_t)width * height);
+    if (planes->walls == NULL || planes->chars == NULL) {
+        fprintf(stderr, "Cannot allocate a board of %d x %d\n", width, height);
+        exit(1);
+    }
+    planes->portals = planes->walls + planes->n_words;
+    planes->dots = planes->walls + 2 * planes->n_words;
+    planes->saved_dots = planes->walls + 3 * planes->n_words;
+
+    rng_t rng;
+    rng_seed(&rng, 1, 0);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t bit = (size_t)y * planes->stride * 64 + x;
+            uint32_t roll = rng_below(&rng, 1000);
+            if (roll < 330) set_bit(planes->walls, bit);
+            else if (roll < 332) set_bit(planes->portals, bit);
+            else if (roll < 900) set_bit(planes->dots, bit);
+        }
+    }
+
+    // The saved state is the same board with some dots not eaten yet
+    memcpy(planes->saved_dots, planes->dots, planes->n_words * sizeof(uint64_t));
+    for (size_t w = DIFF_EVERY / 2; w < planes->n_words; w += DIFF_EVERY) {
+        planes->saved_dots[w] ^= 1;
+    }
+}
+
+// Counts the dots, expands every row and diffs the dot planes cell by cell, the way the board did before
+static void run_cells(const planes_t* planes, results_t* results, long long ns[3]) {
+    long long start_ns = monotonic_ns();
+    results->dots = 0;
+    for (int y = 0; y < planes->height; y++) {
+        for (int x = 0; x < planes->width; x++) {
+            results->dots += test_bit(planes->dots, (size_t)y * planes->stride * 64 + x);
+        }
+    }
+    ns[0] = monotonic_ns() - start_ns;
+
+    start_ns = monotonic_ns();
+    for (int y = 0; y < planes->height; y++) {
+        char* row = planes->chars + (size_t)y * planes->width;
+        for (int x = 0; x < planes->width; x++) {
+            size_t bit = (size_t)y * planes->stride * 64 + x;
+            row[x] = test_bit(planes->walls, bit)     ? glyphs[1]
+                     : test_bit(planes->portals, bit) ? glyphs[2]
+                     : test_bit(planes->dots, bit)    ? glyphs[3]
+                                                       : glyphs[0];
+        }
+    }
+    ns[1] = monotonic_ns() - start_ns;
+    results->chars = hash_chars(planes);
+
+    start_ns = monotonic_ns();
+    results->diffs = 0;
+    for (int y = 0; y < planes->height; y++) {
+        for (int x = 0; x < planes->width; x++) {
+            size_t bit = (size_t)y * planes->stride * 64 + x;
+            results->diffs += test_bit(planes->dots, bit) != test_bit(planes->saved_dots, bit);
+        }
+    }
+    ns[2] = monotonic_ns() - start_ns;
+}
+
+// Same as run_cells with the kernels picked by kernels_use
+static void run_kernels(const planes_t* planes, results_t* results, long long ns[3]) {
+    long long start_ns = monotonic_ns();
+    results->dots = count_bits(planes->dots, planes->n_words);
+    ns[0] = monotonic_ns() - start_ns;
+
+    start_ns = monotonic_ns();
+    for (int y = 0; y < planes->height; y++) {
+        size_t row = (size_t)y * planes->stride;
+        expand_row(planes->walls + row, planes->portals + row, planes->dots + row, planes->width, glyphs,
+                   planes->chars + (size_t)y * planes->width);
+    }
+    ns[1] = monotonic_ns() - start_ns;
+    results->chars = hash_chars(planes);
+
+    start_ns = monotonic_ns();
+    results->diffs = 0;
+    for (size_t w = next_diff(planes->dots, planes->saved_dots, planes->n_words, 0); w < planes->n_words;
+         w = next_diff(planes->dots, planes->saved_dots, planes->n_words, w + 1)) {
+        results->diffs += __builtin_popcountll(planes->dots[w] ^ planes->saved_dots[w]);
+    }
+    ns[2] = monotonic_ns() - start_ns;
+}
+
+// Runs 'run' 'rounds' times and keeps the fastest time of each operation
+static void run_best(void (*run)(const planes_t*, results_t*, long long[3]), const planes_t* planes, int rounds,
+                     results_t* results, long long best[3]) {
+    for (int r = 0; r < rounds; r++) {
+        long long ns[3];
+        run(planes, results, ns);
+        for (int i = 0; i < 3; i++) {
+            if (r == 0 || ns[i] < best[i]) best[i] = ns[i];
+        }
+    }
+}
+
+// FNV-1a of the expanded board, to check the kernels wrote the same characters
+static uint64_t hash_chars(const planes_t* planes) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t n = (size_t)planes->width * planes->height;
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ (unsigned char)planes->chars[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
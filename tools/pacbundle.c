@@ -0,0 +1,31 @@
+#include "bundle.h"
+#include "kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <level_directory> <output_bundle>\n", argv[0]);
+        exit(1);
+    }
+
+    // The level parser builds paths by appending the file names to the directory
+    char levels_dir[MAX_DIRNAME];
+    size_t len = strlen(argv[1]);
+    snprintf(levels_dir, MAX_DIRNAME, "%s%s", argv[1], (len > 0 && argv[1][len - 1] == '/') ? "" : "/");
+
+    kernels_init();
+
+    if (bundle_compile(levels_dir, argv[2]) != 0) {
+        exit(1);
+    }
+
+    struct stat st;
+    if (stat(argv[2], &st) == 0) {
+        printf("Compiled %s into %s (%lld bytes)\n", levels_dir, argv[2], (long long)st.st_size);
+    }
+    return 0;
+}